@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * scx_gamesched - scheduling policy decisions
+ *
+ * The decisions below are pure functions of their arguments, so the BPF
+ * scheduler and the offline simulator (gamesched_sim.c) share one copy of
+ * them. Both must include scx_gamesched.h and provide u32/u64/s64/bool.
+ *
+ * Copyright (c) 2026 GameSched Project
+ */
+#ifndef __GAMESCHED_POLICY_H
+#define __GAMESCHED_POLICY_H
+
+/*
+ * Check if @a is before @b, allowing for wraparound.
+ */
+static inline bool vtime_before(u64 a, u64 b)
+{
+	return (s64)(a - b) < 0;
+}
+
+/*
+ * Get the slice of a @prio task: @prio_slice if set, else @slice, cut to
+ * @slice_min (0 = adaptive slices off) for normal and background tasks
+ * while game work is waiting.
+ */
+static inline u64 policy_slice(u32 prio, u64 slice, u64 prio_slice,
+			       u64 slice_min, bool game_waiting)
+{
+	if (prio_slice)
+		slice = prio_slice;
+
+	if (slice_min && prio >= PRIO_NORMAL && slice > slice_min &&
+	    game_waiting)
+		slice = slice_min;
+
+	return slice;
+}
+
+/*
+ * Get the number of priority levels a CPU consumes, from the highest down:
+ * isolated CPUs only take game work.
+ */
+static inline u32 policy_nr_levels(bool isolated)
+{
+	return isolated ? PRIO_NORMAL : NR_PRIO_LEVELS;
+}
+
+/*
+ * Check if a queued @prio task may preempt a running one.
+ */
+static inline bool policy_may_preempt(u32 preempt_prios, u32 prio)
+{
+	return prio < NR_PRIO_LEVELS && (preempt_prios & (1 << prio));
+}
+
+/*
+ * Check if a CPU running a @cur_prio task is a better preemption victim
+ * than the best so far, which runs @victim_prio (initially the waking
+ * task's own priority).
+ */
+static inline bool policy_better_victim(u32 cur_prio, u32 victim_prio)
+{
+	return cur_prio > victim_prio && cur_prio < NR_PRIO_LEVELS;
+}
+
+/*
+ * Starvation guard: check if a queue that last made progress at
+ * @served_at has waited longer than @age_ns (0 = off) at @now.
+ */
+static inline bool policy_queue_aged(u64 served_at, u64 age_ns, u64 now)
+{
+	return age_ns && vtime_before(served_at + age_ns, now);
+}
+
+/*
+ * Starvation guard: check if a class that ran @class_ns in the first
+ * @elapsed_ns of a budget window is behind its @share_pct percent.
+ */
+static inline bool policy_budget_behind(u64 class_ns, u32 share_pct,
+					u64 elapsed_ns)
+{
+	return share_pct && class_ns * 100 < share_pct * elapsed_ns;
+}
+
+/*
+ * Starvation guard: check if a class that is behind its share may be
+ * served ahead of game work. Its queue must also have gone @min_wait_ns
+ * without progress since @served_at, so a fresh budget window alone
+ * doesn't let new work cut in.
+ */
+static inline bool policy_budget_due(u64 class_ns, u32 share_pct,
+				     u64 elapsed_ns, u64 served_at,
+				     u64 min_wait_ns, u64 now)
+{
+	return policy_budget_behind(class_ns, share_pct, elapsed_ns) &&
+	       vtime_before(served_at + min_wait_ns, now);
+}
+
+#endif /* __GAMESCHED_POLICY_H */
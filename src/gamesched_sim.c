@@ -0,0 +1,808 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * gamesched_sim - Offline replay of a workload against the GameSched policy
+ *
+ * Replays task wakeups, runtimes and affinities on a set of simulated CPUs,
+ * making placement, preemption, slice and dispatch decisions with the same
+ * policy helpers as the BPF scheduler (gamesched_policy.h), and reports
+ * per-class wait latencies and CPU utilization.
+ *
+ * Input is either a trace recorded with `scx_gamesched -t FILE`, or a text
+ * file with one wakeup per line:
+ *
+ *   WAKE_US PID PRIO RUN_US [CPUS]
+ *
+ * PRIO is render, game, normal or background, CPUS an optional affinity
+ * list (default: all). Lines starting with '#' are ignored.
+ *
+ * Not modeled: pinning, LLC shards, vtime ordering, SMT, hybrid capacities,
+ * placement domains, render detection and wakee boosting. Queues are FIFO
+ * and a CPU becomes free as soon as its task stops. Traces don't record
+ * affinities, so a replayed trace lets every task run on every CPU.
+ *
+ * Copyright (c) 2026 GameSched Project
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <errno.h>
+#include <ctype.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint64_t u64;
+typedef int64_t s64;
+
+#include "scx_gamesched.h"
+#include "gamesched_policy.h"
+
+#define NSEC_PER_USEC		1000ULL
+#define NSEC_PER_MSEC		1000000ULL
+
+/* Matches the BPF scheduler's defaults */
+#define SIM_SLICE_DFL		(20 * NSEC_PER_MSEC)
+#define SIM_BUDGET_WINDOW	(100 * NSEC_PER_MSEC)
+
+#define CPU_WORDS		(MAX_CPUS / 64)
+
+const char help_fmt[] =
+"Replay a workload against the GameSched policy.\n"
+"\n"
+"Usage: %s [OPTIONS] TRACE\n"
+"\n"
+"TRACE is a trace recorded with 'scx_gamesched -t' or a text file with\n"
+"lines of 'WAKE_US PID PRIO RUN_US [CPUS]'.\n"
+"\n"
+"Options:\n"
+"  -c NR_CPUS    Number of simulated CPUs (default: 8)\n"
+"  -i CPUS       Isolated CPUs (e.g. 2,3 or 4-7)\n"
+"  -S SLICE_US   Default time slice in us (default: 20000)\n"
+"  -s SLICES     Per-priority time slices in us\n"
+"  -a MIN_US     Adaptive slices: cut normal/background slices to MIN_US\n"
+"                while game work is waiting\n"
+"  -p PRIOS      Priorities that preempt on wakeup (default: render,game)\n"
+"  -g SHARES     Starvation guard shares in percent (default: none)\n"
+"  -A AGE_MS     Starvation guard age (default: 250, 0 disables)\n"
+"  -h            Display this help\n";
+
+static const char *prio_names[NR_PRIO_LEVELS] = {
+	[PRIO_GAME_RENDER]	= "render",
+	[PRIO_GAME_OTHER]	= "game",
+	[PRIO_NORMAL]		= "normal",
+	[PRIO_BACKGROUND]	= "background",
+};
+
+/* Policy knobs, the simulated counterparts of the scheduler's rodata */
+struct sim_config {
+	int nr_cpus;
+	bool isolated[MAX_CPUS];
+	u64 slice_ns;
+	u64 prio_slice_ns[NR_PRIO_LEVELS];
+	u64 slice_min_ns;		/* 0 = adaptive slices off */
+	u32 preempt_prios;
+	u32 prio_share[NR_PRIO_LEVELS];
+	u64 starve_age_ns;
+};
+
+struct sim_task {
+	u64 wake_ns;			/* when the task becomes runnable */
+	u64 run_ns;			/* work to do before sleeping */
+	u64 left_ns;			/* work left */
+	u64 queued_at;			/* last time it became runnable */
+	u32 pid;
+	u32 prio;
+	u64 cpus[CPU_WORDS];		/* affinity */
+	int next;			/* queue link, -1 = tail */
+};
+
+struct sim_cpu {
+	int cur;			/* running task, -1 if idle */
+	u64 started_at;
+	u64 until;			/* when the running task stops */
+	u64 busy_ns;
+	u64 budget_at;			/* start of the budget window */
+	u64 class_ns[NR_PRIO_LEVELS];	/* runtime per class in the window */
+};
+
+struct sim_queue {
+	int head, tail;
+	u32 nr;
+	u64 served_at;			/* last time the queue made progress */
+};
+
+/* Wait times of one class, in the order they happened */
+struct sim_waits {
+	u64 *ns;
+	size_t nr, cap;
+};
+
+static struct sim_config cfg = {
+	.nr_cpus = 8,
+	.slice_ns = SIM_SLICE_DFL,
+	.preempt_prios = (1 << PRIO_GAME_RENDER) | (1 << PRIO_GAME_OTHER),
+	.starve_age_ns = 250 * NSEC_PER_MSEC,
+};
+
+static struct sim_task *tasks;
+static size_t nr_tasks, cap_tasks;
+static struct sim_cpu cpus[MAX_CPUS];
+static struct sim_queue queues[NR_PRIO_LEVELS];
+static struct sim_waits waits[NR_PRIO_LEVELS];
+static u64 class_busy_ns[NR_PRIO_LEVELS];
+static u64 nr_preemptions, nr_budget, nr_aged, nr_direct;
+
+static int parse_priority(const char *str)
+{
+	for (int prio = 0; prio < NR_PRIO_LEVELS; prio++)
+		if (strcmp(str, prio_names[prio]) == 0)
+			return prio;
+	return -1;
+}
+
+/*
+ * Parse a comma-separated list of PRIO=VALUE pairs into @vals, leaving
+ * priorities that aren't mentioned untouched. Returns -1 on error.
+ */
+static int parse_priority_values(const char *str, long *vals)
+{
+	char *copy, *token, *saveptr;
+	int ret = 0;
+
+	copy = strdup(str);
+	if (!copy)
+		return -1;
+
+	for (token = strtok_r(copy, ",", &saveptr); token;
+	     token = strtok_r(NULL, ",", &saveptr)) {
+		char *eq = strchr(token, '=');
+		int prio;
+
+		if (eq)
+			*eq = '\0';
+		prio = parse_priority(token);
+		if (!eq || prio < 0) {
+			fprintf(stderr, "Expected PRIO=VALUE, got: %s\n", token);
+			ret = -1;
+			break;
+		}
+		vals[prio] = atol(eq + 1);
+	}
+
+	free(copy);
+	return ret;
+}
+
+/*
+ * Parse a CPU list ("2,3", "4-7") into the @mask bitmap. Returns the
+ * number of CPUs set, or -1 on error.
+ */
+static int parse_cpu_mask(const char *str, u64 *mask)
+{
+	char *copy, *token, *saveptr;
+	int count = 0;
+
+	copy = strdup(str);
+	if (!copy)
+		return -1;
+
+	memset(mask, 0, CPU_WORDS * sizeof(u64));
+	for (token = strtok_r(copy, ",\n", &saveptr); token;
+	     token = strtok_r(NULL, ",\n", &saveptr)) {
+		char *dash = strchr(token, '-');
+		int first = atoi(token);
+		int last = dash ? atoi(dash + 1) : first;
+
+		if (first < 0 || last >= MAX_CPUS || first > last) {
+			count = -1;
+			break;
+		}
+		for (int cpu = first; cpu <= last; cpu++) {
+			mask[cpu / 64] |= 1ULL << (cpu % 64);
+			count++;
+		}
+	}
+
+	free(copy);
+	return count;
+}
+
+static bool task_allows(const struct sim_task *t, int cpu)
+{
+	return t->cpus[cpu / 64] & (1ULL << (cpu % 64));
+}
+
+/*
+ * A normal or background task whose affinity only holds isolated CPUs
+ * runs there anyway, like must_run_on_isolated() in BPF.
+ */
+static bool task_must_isolated(const struct sim_task *t)
+{
+	for (int cpu = 0; cpu < cfg.nr_cpus; cpu++)
+		if (task_allows(t, cpu) && !cfg.isolated[cpu])
+			return false;
+	return true;
+}
+
+static bool task_fits(const struct sim_task *t, int cpu)
+{
+	if (!task_allows(t, cpu))
+		return false;
+	return !cfg.isolated[cpu] || t->prio < PRIO_NORMAL ||
+	       task_must_isolated(t);
+}
+
+static struct sim_task *add_task(void)
+{
+	if (nr_tasks == cap_tasks) {
+		size_t cap = cap_tasks ? cap_tasks * 2 : 1024;
+		struct sim_task *n = realloc(tasks, cap * sizeof(*tasks));
+
+		if (!n)
+			return NULL;
+		tasks = n;
+		cap_tasks = cap;
+	}
+
+	memset(&tasks[nr_tasks], 0, sizeof(tasks[nr_tasks]));
+	tasks[nr_tasks].next = -1;
+	return &tasks[nr_tasks++];
+}
+
+static void record_wait(u32 prio, u64 ns)
+{
+	struct sim_waits *w = &waits[prio];
+
+	if (w->nr == w->cap) {
+		size_t cap = w->cap ? w->cap * 2 : 1024;
+		u64 *n = realloc(w->ns, cap * sizeof(*w->ns));
+
+		if (!n)
+			return;
+		w->ns = n;
+		w->cap = cap;
+	}
+	w->ns[w->nr++] = ns;
+}
+
+/*
+ * Read a line-based workload. Returns -1 on error.
+ */
+static int load_text(FILE *f, const char *path)
+{
+	char line[512];
+	int lineno = 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		char prio[16], cpulist[256] = "";
+		char *start = line;
+		double wake_us, run_us;
+		struct sim_task *t;
+		unsigned int pid;
+		int n, p;
+
+		lineno++;
+		if (!strchr(line, '\n') && !feof(f)) {
+			fprintf(stderr, "%s:%d: line too long\n", path, lineno);
+			return -1;
+		}
+
+		/* Blank lines and comments, indented or with CRLF endings too */
+		while (isspace((unsigned char)*start))
+			start++;
+		if (*start == '#' || *start == '\0')
+			continue;
+
+		n = sscanf(start, "%lf %u %15s %lf %255s", &wake_us, &pid, prio,
+			   &run_us, cpulist);
+		p = n >= 4 ? parse_priority(prio) : -1;
+		if (p < 0 || wake_us < 0 || run_us <= 0) {
+			fprintf(stderr, "%s:%d: expected WAKE_US PID PRIO RUN_US [CPUS]\n",
+				path, lineno);
+			return -1;
+		}
+
+		t = add_task();
+		if (!t)
+			return -1;
+		t->wake_ns = wake_us * NSEC_PER_USEC;
+		t->run_ns = run_us * NSEC_PER_USEC;
+		t->pid = pid;
+		t->prio = p;
+		if (n < 5)
+			memset(t->cpus, 0xff, sizeof(t->cpus));
+		else if (parse_cpu_mask(cpulist, t->cpus) <= 0) {
+			fprintf(stderr, "%s:%d: invalid CPU list: %s\n",
+				path, lineno, cpulist);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Read a trace recorded by the scheduler. Each run becomes a wakeup at the
+ * time the task became runnable (running time minus its wait) with the
+ * runtime it was charged when it stopped.
+ */
+#define PENDING_SLOTS		4096
+
+struct pending_run {
+	u32 pid;			/* 0 = free */
+	u32 prio;
+	u64 runnable_at;
+};
+
+static int load_trace(FILE *f, const char *path)
+{
+	static struct pending_run pending[PENDING_SLOTS];
+	struct gamesched_trace_event ev;
+	struct gamesched_trace_hdr hdr;
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) ||
+	    hdr.version != TRACE_VERSION || hdr.event_size != sizeof(ev)) {
+		fprintf(stderr, "%s: unsupported trace format\n", path);
+		return -1;
+	}
+
+	/* The runs left out would be missing load, not idle time */
+	if (hdr.sample > 1) {
+		fprintf(stderr, "%s: sampled trace (-R %u), record it without -R\n",
+			path, hdr.sample);
+		return -1;
+	}
+
+	while (fread(&ev, sizeof(ev), 1, f) == 1) {
+		u32 slot = ev.pid % PENDING_SLOTS;
+		struct sim_task *t;
+
+		if (!ev.pid || ev.prio >= NR_PRIO_LEVELS)
+			continue;
+
+		/* Linear probing, a slot is freed as soon as the run ends */
+		for (int i = 0; i < PENDING_SLOTS; i++) {
+			u32 s = (slot + i) % PENDING_SLOTS;
+
+			if (pending[s].pid == ev.pid ||
+			    (!pending[s].pid && ev.type == TRACE_RUNNING)) {
+				slot = s;
+				break;
+			}
+		}
+
+		if (ev.type == TRACE_RUNNING) {
+			pending[slot].pid = ev.pid;
+			pending[slot].prio = ev.prio;
+			pending[slot].runnable_at = ev.ts - ev.arg;
+		} else if (ev.type == TRACE_STOPPING &&
+			   pending[slot].pid == ev.pid) {
+			pending[slot].pid = 0;
+			if (!ev.arg)
+				continue;
+
+			t = add_task();
+			if (!t)
+				return -1;
+			t->wake_ns = pending[slot].runnable_at;
+			t->run_ns = ev.arg;
+			t->pid = ev.pid;
+			t->prio = pending[slot].prio;
+			memset(t->cpus, 0xff, sizeof(t->cpus));
+		}
+	}
+
+	return 0;
+}
+
+static int cmp_wake(const void *a, const void *b)
+{
+	const struct sim_task *x = a, *y = b;
+
+	return x->wake_ns < y->wake_ns ? -1 : x->wake_ns > y->wake_ns;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int load_workload(const char *path)
+{
+	char magic[sizeof(TRACE_MAGIC)] = "";
+	u64 base;
+	FILE *f;
+	int ret;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (fread(magic, sizeof(magic), 1, f) == 1 &&
+	    !memcmp(magic, TRACE_MAGIC, sizeof(magic))) {
+		rewind(f);
+		ret = load_trace(f, path);
+	} else {
+		rewind(f);
+		ret = load_text(f, path);
+	}
+	fclose(f);
+	if (ret < 0)
+		return -1;
+
+	if (!nr_tasks) {
+		fprintf(stderr, "%s: no wakeups to replay\n", path);
+		return -1;
+	}
+
+	/* Start the replay at the first wakeup */
+	qsort(tasks, nr_tasks, sizeof(*tasks), cmp_wake);
+	base = tasks[0].wake_ns;
+	for (size_t i = 0; i < nr_tasks; i++) {
+		tasks[i].wake_ns -= base;
+		tasks[i].left_ns = tasks[i].run_ns;
+	}
+
+	return 0;
+}
+
+/*
+ * Queue operations, standing in for the priority DSQs.
+ */
+static void enqueue(int idx, u64 now)
+{
+	struct sim_queue *q = &queues[tasks[idx].prio];
+
+	/* A queue starts aging when its first task arrives, like mark_served() */
+	if (!q->nr)
+		q->served_at = now;
+
+	tasks[idx].queued_at = now;
+	tasks[idx].next = -1;
+	if (q->tail >= 0)
+		tasks[q->tail].next = idx;
+	else
+		q->head = idx;
+	q->tail = idx;
+	q->nr++;
+}
+
+/* Remove and return the first task of @prio that may run on @cpu, or -1 */
+static int consume(u32 prio, int cpu, u64 now)
+{
+	struct sim_queue *q = &queues[prio];
+	int prev = -1;
+
+	for (int idx = q->head; idx >= 0; prev = idx, idx = tasks[idx].next) {
+		if (!task_fits(&tasks[idx], cpu))
+			continue;
+
+		if (prev >= 0)
+			tasks[prev].next = tasks[idx].next;
+		else
+			q->head = tasks[idx].next;
+		if (q->tail == idx)
+			q->tail = prev;
+		q->nr--;
+		q->served_at = now;
+		return idx;
+	}
+
+	return -1;
+}
+
+static bool game_waiting(void)
+{
+	return queues[PRIO_GAME_RENDER].nr || queues[PRIO_GAME_OTHER].nr;
+}
+
+static void start_task(int cpu, int idx, u64 now)
+{
+	struct sim_task *t = &tasks[idx];
+	u64 slice;
+
+	slice = policy_slice(t->prio, cfg.slice_ns, cfg.prio_slice_ns[t->prio],
+			     cfg.slice_min_ns, game_waiting());
+
+	record_wait(t->prio, now - t->queued_at);
+	cpus[cpu].cur = idx;
+	cpus[cpu].started_at = now;
+	cpus[cpu].until = now + (t->left_ns < slice ? t->left_ns : slice);
+}
+
+/*
+ * Stop the task running on @cpu at @now, putting it back in its queue if
+ * it has work left (slice expiry or preemption).
+ */
+static void stop_task(int cpu, u64 now)
+{
+	struct sim_cpu *c = &cpus[cpu];
+	struct sim_task *t = &tasks[c->cur];
+	u64 ran = now - c->started_at;
+
+	t->left_ns -= ran < t->left_ns ? ran : t->left_ns;
+	c->busy_ns += ran;
+	c->class_ns[t->prio] += ran;
+	class_busy_ns[t->prio] += ran;
+
+	if (t->left_ns)
+		enqueue(c->cur, now);
+	c->cur = -1;
+}
+
+/*
+ * Pick the next task for an idle @cpu, like gamesched_dispatch: starved
+ * normal/background queues first while game work waits, then strict
+ * priority order.
+ */
+static void dispatch(int cpu, u64 now)
+{
+	struct sim_cpu *c = &cpus[cpu];
+	u32 nr_levels = policy_nr_levels(cfg.isolated[cpu]);
+	u64 elapsed = now - c->budget_at;
+	bool game_waiting;
+	u32 prio;
+	int idx;
+
+	if (elapsed >= SIM_BUDGET_WINDOW) {
+		memset(c->class_ns, 0, sizeof(c->class_ns));
+		c->budget_at = now;
+		elapsed = 0;
+	}
+
+	game_waiting = queues[PRIO_GAME_RENDER].nr || queues[PRIO_GAME_OTHER].nr;
+	for (prio = PRIO_NORMAL; game_waiting && prio < nr_levels; prio++) {
+		bool aged, behind;
+
+		if (!queues[prio].nr)
+			continue;
+
+		aged = policy_queue_aged(queues[prio].served_at,
+					 cfg.starve_age_ns, now);
+		behind = policy_budget_due(c->class_ns[prio],
+					   cfg.prio_share[prio], elapsed,
+					   queues[prio].served_at, cfg.slice_ns,
+					   now);
+		if (!aged && !behind)
+			continue;
+
+		idx = consume(prio, cpu, now);
+		if (idx >= 0) {
+			if (aged)
+				nr_aged++;
+			else
+				nr_budget++;
+			start_task(cpu, idx, now);
+			return;
+		}
+	}
+
+	/*
+	 * Past nr_levels, only tasks that can't run anywhere else fit an
+	 * isolated CPU. BPF queues those on the CPU's local DSQ.
+	 */
+	for (prio = 0; prio < NR_PRIO_LEVELS; prio++) {
+		idx = consume(prio, cpu, now);
+		if (idx >= 0) {
+			start_task(cpu, idx, now);
+			return;
+		}
+	}
+}
+
+/*
+ * Handle the wakeup of task @idx, like gamesched_select_cpu and
+ * gamesched_enqueue: take an idle CPU if one fits, otherwise queue and
+ * preempt the CPU running the lowest-priority task.
+ */
+static void wakeup(int idx, u64 now)
+{
+	struct sim_task *t = &tasks[idx];
+	u32 victim_prio = t->prio;
+	int cpu, victim = -1;
+
+	t->queued_at = now;
+	for (cpu = 0; cpu < cfg.nr_cpus; cpu++) {
+		if (cpus[cpu].cur < 0 && task_fits(t, cpu)) {
+			nr_direct++;
+			start_task(cpu, idx, now);
+			return;
+		}
+	}
+
+	enqueue(idx, now);
+	if (!policy_may_preempt(cfg.preempt_prios, t->prio))
+		return;
+
+	for (cpu = 0; cpu < cfg.nr_cpus; cpu++) {
+		u32 cur_prio;
+
+		if (cpus[cpu].cur < 0 || !task_fits(t, cpu))
+			continue;
+		cur_prio = tasks[cpus[cpu].cur].prio;
+		if (!policy_better_victim(cur_prio, victim_prio))
+			continue;
+		victim = cpu;
+		victim_prio = cur_prio;
+		if (victim_prio == PRIO_BACKGROUND)
+			break;
+	}
+
+	if (victim >= 0) {
+		nr_preemptions++;
+		stop_task(victim, now);
+		dispatch(victim, now);
+	}
+}
+
+/*
+ * Run the replay. Returns the simulated duration.
+ */
+static u64 simulate(void)
+{
+	size_t next = 0;
+	u64 now = 0;
+
+	for (int cpu = 0; cpu < cfg.nr_cpus; cpu++)
+		cpus[cpu].cur = -1;
+	for (int prio = 0; prio < NR_PRIO_LEVELS; prio++)
+		queues[prio].head = queues[prio].tail = -1;
+
+	for (;;) {
+		int stop_cpu = -1;
+
+		for (int cpu = 0; cpu < cfg.nr_cpus; cpu++)
+			if (cpus[cpu].cur >= 0 &&
+			    (stop_cpu < 0 || cpus[cpu].until < cpus[stop_cpu].until))
+				stop_cpu = cpu;
+
+		if (next < nr_tasks &&
+		    (stop_cpu < 0 || tasks[next].wake_ns < cpus[stop_cpu].until)) {
+			now = tasks[next].wake_ns;
+			wakeup(next++, now);
+		} else if (stop_cpu >= 0) {
+			now = cpus[stop_cpu].until;
+			stop_task(stop_cpu, now);
+			dispatch(stop_cpu, now);
+		} else {
+			break;
+		}
+	}
+
+	return now;
+}
+
+static void print_results(u64 duration)
+{
+	u64 total_busy = 0, total_runs = 0;
+	int prio, cpu;
+
+	for (prio = 0; prio < NR_PRIO_LEVELS; prio++) {
+		total_busy += class_busy_ns[prio];
+		total_runs += waits[prio].nr;
+	}
+
+	printf("simulated %.3fs: %zu wakeups, %lu runs on %d CPUs\n",
+	       duration / 1e9, nr_tasks, total_runs, cfg.nr_cpus);
+	printf("direct=%lu preempt=%lu budget=%lu aged=%lu\n",
+	       nr_direct, nr_preemptions, nr_budget, nr_aged);
+
+	for (prio = 0; prio < NR_PRIO_LEVELS; prio++) {
+		struct sim_waits *w = &waits[prio];
+
+		if (!w->nr)
+			continue;
+
+		qsort(w->ns, w->nr, sizeof(*w->ns), cmp_u64);
+		printf("  wait %-10s n=%zu p50=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus cpu=%.1f%%\n",
+		       prio_names[prio], w->nr,
+		       w->ns[w->nr * 50 / 100] / 1e3,
+		       w->ns[w->nr * 99 / 100] / 1e3,
+		       w->ns[w->nr * 999 / 1000] / 1e3,
+		       w->ns[w->nr - 1] / 1e3,
+		       duration ? 100.0 * class_busy_ns[prio] /
+				  ((double)duration * cfg.nr_cpus) : 0);
+	}
+
+	printf("  util total=%.1f%%",
+	       duration ? 100.0 * total_busy / ((double)duration * cfg.nr_cpus) : 0);
+	for (cpu = 0; cpu < cfg.nr_cpus; cpu++)
+		printf(" %d:%.1f%%%s", cpu,
+		       duration ? 100.0 * cpus[cpu].busy_ns / duration : 0,
+		       cfg.isolated[cpu] ? "*" : "");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	long vals[NR_PRIO_LEVELS];
+	u64 mask[CPU_WORDS];
+	int opt, prio;
+
+	while ((opt = getopt(argc, argv, "c:i:S:s:a:p:g:A:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			cfg.nr_cpus = atoi(optarg);
+			if (cfg.nr_cpus <= 0 || cfg.nr_cpus > MAX_CPUS) {
+				fprintf(stderr, "Invalid number of CPUs: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'i':
+			if (parse_cpu_mask(optarg, mask) < 0) {
+				fprintf(stderr, "Invalid CPU list: %s\n", optarg);
+				return 1;
+			}
+			for (int cpu = 0; cpu < MAX_CPUS; cpu++)
+				cfg.isolated[cpu] = mask[cpu / 64] & (1ULL << (cpu % 64));
+			break;
+		case 'S':
+			cfg.slice_ns = atol(optarg) * NSEC_PER_USEC;
+			if (!cfg.slice_ns) {
+				fprintf(stderr, "Invalid slice: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			memset(vals, 0, sizeof(vals));
+			if (parse_priority_values(optarg, vals) < 0)
+				return 1;
+			for (prio = 0; prio < NR_PRIO_LEVELS; prio++)
+				if (vals[prio] > 0)
+					cfg.prio_slice_ns[prio] = vals[prio] * NSEC_PER_USEC;
+			break;
+		case 'a':
+			cfg.slice_min_ns = atol(optarg) * NSEC_PER_USEC;
+			break;
+		case 'p':
+			cfg.preempt_prios = 0;
+			if (strcmp(optarg, "none") == 0)
+				break;
+			for (char *tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+				prio = parse_priority(tok);
+				if (prio < 0) {
+					fprintf(stderr, "Invalid priority: %s\n", tok);
+					return 1;
+				}
+				cfg.preempt_prios |= 1 << prio;
+			}
+			break;
+		case 'g':
+			for (prio = 0; prio < NR_PRIO_LEVELS; prio++)
+				vals[prio] = cfg.prio_share[prio];
+			if (parse_priority_values(optarg, vals) < 0)
+				return 1;
+			for (prio = 0; prio < NR_PRIO_LEVELS; prio++)
+				cfg.prio_share[prio] = vals[prio];
+			break;
+		case 'A':
+			cfg.starve_age_ns = atol(optarg) * NSEC_PER_MSEC;
+			break;
+		case 'h':
+		default:
+			fprintf(opt == 'h' ? stdout : stderr, help_fmt,
+				basename(argv[0]));
+			return opt != 'h';
+		}
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, help_fmt, basename(argv[0]));
+		return 1;
+	}
+
+	if (load_workload(argv[optind]) < 0)
+		return 1;
+
+	print_results(simulate());
+	return 0;
+}
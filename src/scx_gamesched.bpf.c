@@ -7,30 +7,151 @@
  * - Tasks registered as "game other" get high priority (DSQ 1)
  * - Normal tasks go to DSQ 2, background to DSQ 3
  * - Dispatch consumes from lower-numbered DSQs first
+ * - Optionally, tasks within a DSQ are ordered by weighted vtime instead of
+ *   FIFO so CPU hogs can't monopolize their priority level
+ * - Game tasks queued while no CPU is idle preempt the lowest-priority
+ *   running task (per-priority policy)
+ * - Optionally, each LLC gets its own set of priority DSQs and CPUs only
+ *   steal from other LLCs when their local shard is empty
+ *
+ * Registration:
+ * - Threads are registered one by one, or a whole process by TGID
+ * - Threads of a registered TGID are classified from their first wakeup,
+ *   optionally by thread-name prefix (e.g. "RenderThread" -> render)
  *
  * CPU Isolation:
  * - User can mark specific CPUs as "isolated"
  * - Only pinned game threads (and RT/percpu kthreads) run on isolated CPUs
+ * - Pinned threads are queued on a DSQ only their pinned CPU consumes
  * - Normal tasks are steered away from isolated CPUs
+ * - Isolated CPUs only consume game DSQs and go idle otherwise
  *
  * Copyright (c) 2026 GameSched Project
  */
 #include <scx/common.bpf.h>
 #include "scx_gamesched.h"
+#include "gamesched_policy.h"
 
 char _license[] SEC("license") = "GPL";
 
 /*
  * User-configurable parameters (set from userspace before load)
  */
+const volatile u32 sched_flags;		/* GAMESCHED_FLAG_* */
 const volatile u64 slice_ns = SCX_SLICE_DFL;
+const volatile bool llc_shards;		/* shard priority DSQs per LLC */
+const volatile u32 preempt_prios = (1 << PRIO_GAME_RENDER) |
+				   (1 << PRIO_GAME_OTHER);	/* may preempt */
+const volatile bool vtime_enabled;	/* weighted vtime order within DSQs */
+const volatile u64 prio_slice_ns[NR_PRIO_LEVELS];	/* 0 = slice_ns */
+const volatile bool adaptive_slice;	/* shrink normal slices under game load */
+const volatile u64 slice_min_ns = 1000000;	/* adaptive slice floor */
+
+/*
+ * Render-thread detection: threads of registered TGIDs that wake up with a
+ * stable period in [detect_min_period_ns, detect_max_period_ns] and jitter
+ * below detect_jitter_pct percent of it for DETECT_MIN_SAMPLES wakeups in a
+ * row are promoted to render, until they go detect_timeout_ns without a
+ * periodic wakeup.
+ */
+const volatile bool render_detect;
+const volatile u64 detect_min_period_ns = 4000000;	/* 250 Hz */
+const volatile u64 detect_max_period_ns = 34000000;	/* ~30 Hz */
+const volatile u64 detect_timeout_ns = 1000000000;
+const volatile u32 detect_jitter_pct = 10;
+
+#define DETECT_MIN_SAMPLES	8
+
+/*
+ * Wakee boosting: a task woken by a game thread runs in its waker's class
+ * for one run, at most one waker-class slice, so unregistered pipeline
+ * stages (driver workers, audio, the compositor) don't queue behind
+ * normal tasks.
+ */
+const volatile bool boost_wakees;
+
+/*
+ * CPU topology (filled by userspace from sysfs before load)
+ */
+const volatile u32 nr_llcs = 1;
+const volatile u32 cpu_llc_id[MAX_CPUS];
+const volatile s32 cpu_sibling[MAX_CPUS];	/* SMT sibling, -1 if none */
+
+/* Placement domains, see enum gamesched_domain */
+const volatile bool domains_enabled;
+const volatile u8 cpu_domain[MAX_CPUS];
+
+/*
+ * Hybrid steering: game tasks prefer the highest-capacity (P) cores and
+ * background tasks the others (E cores). A CPU only takes work of the other
+ * class once the queue of that class outgrows the CPUs it prefers.
+ */
+const volatile bool hybrid_steering;
+
+/*
+ * Frequency control: when a task starts running, request its class's perf
+ * target from cpufreq. Render runs at its target, the other classes follow
+ * the CPU's utilization up to theirs. Values scale to SCX_CPUPERF_ONE.
+ */
+const volatile bool cpuperf_control;
+const volatile u32 prio_perf[NR_PRIO_LEVELS] = {
+	[PRIO_GAME_RENDER]	= SCX_CPUPERF_ONE,
+	[PRIO_GAME_OTHER]	= SCX_CPUPERF_ONE,
+	[PRIO_NORMAL]		= SCX_CPUPERF_ONE,
+	[PRIO_BACKGROUND]	= SCX_CPUPERF_ONE / 2,
+};
+
+/*
+ * Starvation guard, only consulted while game work is waiting. A normal or
+ * background queue that hasn't made progress for starve_age_ns is served
+ * first. Opt-in (-g), each CPU also guarantees those classes prio_share
+ * percent of its time per budget window, serving them ahead of game work
+ * while they are behind and have waited a slice. Zero disables either.
+ */
+const volatile u32 prio_share[NR_PRIO_LEVELS];
+const volatile u64 budget_window_ns = 100ULL * 1000 * 1000;
+const volatile u64 starve_age_ns = 250ULL * 1000 * 1000;
+
+/*
+ * Scheduling trace: emit the events of the classes in trace_prios to the
+ * trace_events ring buffer, sampling one in trace_sample. A sampled run
+ * gets both its RUNNING and STOPPING events.
+ */
+const volatile bool trace_enabled;
+const volatile u32 trace_prios = (1 << NR_PRIO_LEVELS) - 1;
+const volatile u32 trace_sample = 1;
+
+/* Default size of the trace ring buffer */
+#define TRACE_RINGBUF_SIZE	(1 << 20)
+
+/* Utilization sampling window for frequency control */
+#define UTIL_WINDOW_NS		(4ULL * 1000 * 1000)
+
+/*
+ * Quiet siblings: keep the SMT sibling of an isolated CPU idle while a
+ * render task runs there, so the render thread gets the whole core.
+ */
+const volatile bool quiet_siblings;
+
+/*
+ * Strict isolation: only admit kernel threads bound to their CPU onto
+ * isolated CPUs, and steer unbound ones (kworkers etc.) elsewhere.
+ */
+const volatile bool strict_isolation;
 
 UEI_DEFINE(uei);
 
 /*
- * DSQ IDs for each priority level
+ * DSQ IDs for each priority level. In LLC-sharded mode every LLC gets its
+ * own set of priority DSQs starting at DSQ_LLC_BASE. Every CPU also has a
+ * DSQ at DSQ_CPU_BASE + cpu holding the threads pinned to it.
  */
 #define DSQ_PRIO_BASE	0
+#define DSQ_LLC_BASE	0x100
+#define DSQ_CPU_BASE	0x1000
+
+/* Game levels of each named isolation partition, see part_dsq() */
+#define DSQ_PART_BASE	0x2000
 
 /*
  * Map: game_threads - tracks which PIDs are game threads and their priority
@@ -40,22 +161,35 @@ UEI_DEFINE(uei);
 struct {
 	__uint(type, BPF_MAP_TYPE_HASH);
 	__uint(max_entries, MAX_GAME_THREADS);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
 	__type(key, u32);
 	__type(value, u32);
 } game_threads SEC(".maps");
 
 /*
  * Map: isolated_cpus - marks which CPUs are isolated for game threads
- * Key: cpu id (u32)
- * Value: 1 if isolated, 0 otherwise
+ * Key: ISOLATION_SLOT(generation, cpu id) (u32)
+ * Value: isolation partition + 1 if isolated, 0 otherwise
  */
 struct {
 	__uint(type, BPF_MAP_TYPE_ARRAY);
-	__uint(max_entries, MAX_CPUS);
+	__uint(max_entries, 2 * MAX_CPUS);
 	__type(key, u32);
 	__type(value, u32);
 } isolated_cpus SEC(".maps");
 
+/*
+ * Map: partitions - named isolation partitions and their owners
+ * Key: partition (u32), 1 to MAX_PARTITIONS - 1
+ * Value: struct gamesched_partition
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, MAX_PARTITIONS);
+	__type(key, u32);
+	__type(value, struct gamesched_partition);
+} partitions SEC(".maps");
+
 /*
  * Map: pinned_threads - which game threads are pinned to which CPU
  * Key: pid (u32)
@@ -64,179 +198,2552 @@ struct {
 struct {
 	__uint(type, BPF_MAP_TYPE_HASH);
 	__uint(max_entries, MAX_GAME_THREADS);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
 	__type(key, u32);
 	__type(value, s32);
 } pinned_threads SEC(".maps");
 
 /*
- * Statistics
+ * Map: game_tgids - whole processes registered as games
+ * Key: tgid (u32)
+ * Value: default priority of the process's threads (enum gamesched_priority)
  */
-u64 nr_game_dispatched;
-u64 nr_normal_dispatched;
-u64 nr_isolated_violations;  /* times we prevented normal task on isolated CPU */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, MAX_GAME_THREADS);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, u32);
+	__type(value, u32);
+} game_tgids SEC(".maps");
 
 /*
- * Get the priority level for a task.
- * Returns PRIO_NORMAL for unregistered tasks.
+ * Map: game_cgroups - cgroups whose tasks are classified as games
+ * Key: cgroup id (u64)
+ * Value: default priority of the cgroup's tasks (enum gamesched_priority)
  */
-static u32 get_task_priority(struct task_struct *p)
-{
-	u32 pid = p->pid;
-	u32 *prio;
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, MAX_GAME_CGROUPS);
+	__type(key, u64);
+	__type(value, u32);
+} game_cgroups SEC(".maps");
 
-	prio = bpf_map_lookup_elem(&game_threads, &pid);
-	if (prio)
-		return *prio;
+/* Deepest cgroup nesting searched for a registered ancestor */
+#define MAX_CGROUP_DEPTH	16
 
-	return PRIO_NORMAL;
-}
+/*
+ * Map: comm_rules - thread-name rules applied to threads of game_tgids
+ * Key: rule slot (u32)
+ * Value: struct gamesched_comm_rule
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, MAX_COMM_RULES);
+	__type(key, u32);
+	__type(value, struct gamesched_comm_rule);
+} comm_rules SEC(".maps");
 
 /*
- * Check if a CPU is isolated.
+ * Map: detected_threads - threads currently promoted by the render detector
+ * Key: pid (u32)
+ * Value: struct gamesched_detected
  */
-static bool is_cpu_isolated(s32 cpu)
-{
-	u32 cpu_key = cpu;
-	u32 *isolated;
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, MAX_GAME_THREADS);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, u32);
+	__type(value, struct gamesched_detected);
+} detected_threads SEC(".maps");
 
-	if (cpu < 0)
-		return false;
+/*
+ * Map: thread_stats - live per-thread data for status
+ * Key: pid (u32)
+ * Value: struct gamesched_thread_stats
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, MAX_GAME_THREADS);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, u32);
+	__type(value, struct gamesched_thread_stats);
+} thread_stats SEC(".maps");
+
+/*
+ * Map: generation - change counters bumped by userspace (enum gamesched_gen)
+ * Key: generation slot (u32)
+ * Value: counter (u64)
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, NR_GENS);
+	__type(key, u32);
+	__type(value, u64);
+} generation SEC(".maps");
+
+/*
+ * Map: sched_info - load-time settings userspace publishes for the CLI
+ * Key: enum gamesched_info (u32)
+ * Value: u32
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, NR_INFOS);
+	__type(key, u32);
+	__type(value, u32);
+} sched_info SEC(".maps");
+
+/*
+ * Per-task context, cached in task local storage so the hot path doesn't
+ * have to hash the pid into game_threads/pinned_threads on every callback.
+ * The cache is refilled whenever GEN_REGISTRY moves past @gen.
+ */
+struct task_ctx {
+	u64 gen;		/* GEN_REGISTRY value the cache was filled at */
+	u32 prio;		/* enum gamesched_priority */
+	s32 pinned_cpu;		/* -1 if not pinned */
+	u32 flags;		/* TASK_F_* */
+	u32 partition;		/* named partition owning the task, 0 if none */
+	u64 started_at;		/* when the task last started running */
+	u64 runnable_at;	/* when the task started waiting, 0 if running */
+	u64 wait_ns;		/* how long the current run waited */
+	bool trace_run;		/* the current run is sampled into the trace */
+
+	/* Render detection state */
+	u32 base_prio;		/* priority from registration alone */
+	u32 nr_periodic;	/* consecutive periodic wakeups */
+	u64 last_wakeup;
+	u64 period_ewma;
+	u64 jitter_ewma;
+	u64 run_ewma;
+	u64 detected_until;	/* promotion expiry */
+
+	/* Wakee boost state */
+	u32 boost_prio;		/* NR_PRIO_LEVELS when not boosted */
+	u64 boosted_until;
+	u64 boost_vtime;	/* own-level vtime saved while boosted */
+
+	struct bpf_cpumask __kptr *tmp_mask;	/* scratch for CPU selection */
+};
+
+/* Task class flags */
+#define TASK_F_GAME	(1 << 0)	/* registered game thread, any priority */
+#define TASK_F_GROUP	(1 << 1)	/* classified through its TGID or cgroup */
+#define TASK_F_DETECTED	(1 << 2)	/* promoted by the render detector */
+
+struct {
+	__uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, int);
+	__type(value, struct task_ctx);
+} task_ctxs SEC(".maps");
+
+/*
+ * Map: llc_masks - CPUs sharing each last-level cache
+ * Key: LLC index (u32)
+ */
+struct llc_ctx {
+	struct bpf_cpumask __kptr *cpumask;
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, MAX_LLCS);
+	__type(key, u32);
+	__type(value, struct llc_ctx);
+} llc_masks SEC(".maps");
+
+/*
+ * Map: partition_masks - CPUs of each named isolation partition, rebuilt
+ * with the isolation masks
+ * Key: partition (u32)
+ */
+struct partition_ctx {
+	struct bpf_cpumask __kptr *cpumask;
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, MAX_PARTITIONS);
+	__type(key, u32);
+	__type(value, struct partition_ctx);
+} partition_masks SEC(".maps");
+
+/*
+ * Per-CPU context
+ */
+struct cpu_ctx {
+	u32 cur_prio;		/* priority of the running task, NR_PRIO_LEVELS if none */
+	bool big;		/* hybrid: one of the highest-capacity CPUs */
+	u32 util;		/* busy fraction EWMA, scaled to SCX_CPUPERF_ONE */
+	u64 util_at;		/* start of the current utilization window */
+	u64 util_busy;		/* busy time in the current window */
+	u64 budget_at;		/* start of the current budget window */
+	u64 class_ns[NR_PRIO_LEVELS]; /* runtime per class in the window */
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(max_entries, 1);
+	__type(key, u32);
+	__type(value, struct cpu_ctx);
+} cpu_ctxs SEC(".maps");
+
+/*
+ * Isolation set and its complement, rebuilt from isolated_cpus and swapped
+ * in whenever GEN_ISOLATION changes.
+ */
+private(GAMESCHED) struct bpf_cpumask __kptr *isolated_mask;
+private(GAMESCHED) struct bpf_cpumask __kptr *nonisolated_mask;
+static u64 isolation_gen = ~0ULL;
+static u32 nr_isolated;
+
+/*
+ * CPUs outside every named partition, and the partition of each CPU (0 for
+ * the shared set and non-isolated CPUs).
+ */
+private(GAMESCHED) struct bpf_cpumask __kptr *unpartitioned_mask;
+u8 cpu_partition[MAX_CPUS];
+static u32 nr_partitioned;
+
+/* CPUs of each placement domain, built at init */
+private(GAMESCHED) struct bpf_cpumask __kptr *game_domain_mask;
+private(GAMESCHED) struct bpf_cpumask __kptr *system_domain_mask;
+
+/* Hybrid: highest-capacity CPUs and the rest, built at init */
+private(GAMESCHED) struct bpf_cpumask __kptr *big_mask;
+private(GAMESCHED) struct bpf_cpumask __kptr *little_mask;
+static u32 nr_big_cpus, nr_little_cpus;
+
+enum cpu_capacity_class {
+	CAP_ANY,
+	CAP_BIG,
+	CAP_LITTLE,
+};
+
+/*
+ * Current vtime of each priority level (vtime mode)
+ */
+u64 vtime_now[NR_PRIO_LEVELS];
+
+/*
+ * Last time each priority queue made progress: a task was consumed from
+ * it, or it went from empty to non-empty. Indexed by queue_slot().
+ */
+u64 queue_served_at[MAX_LLCS * NR_PRIO_LEVELS];
+
+/* Last perf target requested per CPU, read by the monitor */
+u32 cpu_perf_target[MAX_CPUS];
+
+/*
+ * Map: stats - per-CPU statistics, summed by userspace
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(max_entries, 1);
+	__type(key, u32);
+	__type(value, struct gamesched_stats);
+} stats SEC(".maps");
+
+/*
+ * Map: partition_stats - per-CPU statistics of each isolation partition
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(max_entries, MAX_PARTITIONS);
+	__type(key, u32);
+	__type(value, struct gamesched_partition_stats);
+} partition_stats SEC(".maps");
 
-	isolated = bpf_map_lookup_elem(&isolated_cpus, &cpu_key);
-	return isolated && *isolated;
+/*
+ * Map: lat_hists - per-CPU scheduling latency histograms
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(max_entries, 1);
+	__type(key, u32);
+	__type(value, struct gamesched_lat_hist);
+} lat_hists SEC(".maps");
+
+/*
+ * Scheduling trace events, see struct gamesched_trace_event.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_RINGBUF);
+	__uint(max_entries, TRACE_RINGBUF_SIZE);
+} trace_events SEC(".maps");
+
+#define STAT_ADD(field, val)						\
+	do {								\
+		u32 __zero = 0;						\
+		struct gamesched_stats *__s =				\
+			bpf_map_lookup_elem(&stats, &__zero);		\
+		if (__s)						\
+			__s->field += (val);				\
+	} while (0)
+
+#define STAT_INC(field)		STAT_ADD(field, 1)
+
+#define PART_STAT_ADD(part, field, val)					\
+	do {								\
+		u32 __part = (part);					\
+		struct gamesched_partition_stats *__s =			\
+			bpf_map_lookup_elem(&partition_stats, &__part);	\
+		if (__s)						\
+			__s->field += (val);				\
+	} while (0)
+
+#define PART_STAT_INC(part, field)	PART_STAT_ADD(part, field, 1)
+
+/*
+ * Pick one in trace_sample events.
+ */
+static bool trace_sampled(void)
+{
+	return trace_sample <= 1 || !(bpf_get_prandom_u32() % trace_sample);
 }
 
 /*
- * Check if a task is allowed on an isolated CPU.
- * Game threads (any priority) are allowed on isolated CPUs.
+ * Emit a trace event for @p, subject to the class filter. Sampling is up
+ * to the caller.
  */
-static bool task_allowed_on_isolated(struct task_struct *p)
+static void trace_emit(struct task_struct *p, u32 type, u32 prio, s32 cpu,
+		       u32 reason, u64 arg)
 {
-	u32 pid = p->pid;
-	u32 prio = get_task_priority(p);
+	struct gamesched_trace_event *ev;
 
-	/* Game threads are allowed */
-	if (prio == PRIO_GAME_RENDER || prio == PRIO_GAME_OTHER)
-		return true;
+	if (!trace_enabled || prio >= NR_PRIO_LEVELS ||
+	    !(trace_prios & (1 << prio)))
+		return;
 
-	/* Kernel threads are allowed (RT, percpu, etc.) */
-	if (p->flags & PF_KTHREAD)
-		return true;
+	ev = bpf_ringbuf_reserve(&trace_events, sizeof(*ev), 0);
+	if (!ev) {
+		STAT_INC(nr_trace_dropped);
+		return;
+	}
 
-	return false;
+	ev->ts = bpf_ktime_get_ns();
+	ev->arg = arg;
+	ev->pid = p->pid;
+	ev->cpu = cpu;
+	ev->type = type;
+	ev->prio = prio;
+	ev->reason = reason;
+	__builtin_memset(ev->pad, 0, sizeof(ev->pad));
+	bpf_ringbuf_submit(ev, 0);
 }
 
 /*
- * Get the pinned CPU for a task, or -1 if not pinned.
+ * Emit a sampled trace event for @p.
  */
-static s32 get_pinned_cpu(struct task_struct *p)
+static void trace_event(struct task_struct *p, u32 type, u32 prio, s32 cpu,
+			u32 reason, u64 arg)
 {
-	u32 pid = p->pid;
-	s32 *cpu;
+	if (trace_enabled && trace_sampled())
+		trace_emit(p, type, prio, cpu, reason, arg);
+}
 
-	cpu = bpf_map_lookup_elem(&pinned_threads, &pid);
-	if (cpu)
-		return *cpu;
+/*
+ * Check if a GAMESCHED_FLAG_* feature is part of this load. Resolved from
+ * rodata, so the verifier prunes the paths of disabled features.
+ */
+static inline bool has_feature(u32 flag)
+{
+	return !(sched_flags & GAMESCHED_FLAG_ENABLED) || (sched_flags & flag);
+}
 
-	return -1;
+/*
+ * Check if any CPU is isolated right now. Isolation set up at runtime
+ * takes effect with the next refresh_isolation().
+ */
+static inline bool isolation_active(void)
+{
+	return has_feature(GAMESCHED_FLAG_ISOLATION) && nr_isolated;
 }
 
 /*
- * Select CPU for a task.
- * - Pinned game threads go to their pinned CPU
- * - Normal tasks avoid isolated CPUs
+ * Read a generation counter.
  */
-s32 BPF_STRUCT_OPS(gamesched_select_cpu, struct task_struct *p,
-		   s32 prev_cpu, u64 wake_flags)
+static u64 read_gen(u32 idx)
 {
-	s32 pinned_cpu;
-	bool is_idle = false;
-	s32 cpu;
+	u64 *gen;
 
-	/* Check if this task is pinned to a specific CPU */
-	pinned_cpu = get_pinned_cpu(p);
-	if (pinned_cpu >= 0) {
-		/* Try to dispatch directly if the pinned CPU is idle */
-		if (scx_bpf_test_and_clear_cpu_idle(pinned_cpu)) {
-			scx_bpf_dispatch(p, SCX_DSQ_LOCAL_ON | pinned_cpu,
-					 slice_ns, 0);
-		}
-		return pinned_cpu;
-	}
+	gen = bpf_map_lookup_elem(&generation, &idx);
+	return gen ? *gen : 0;
+}
+
+/*
+ * Classify a thread of a registered TGID by its comm. Returns the priority
+ * of the first matching rule, or @prio if none matches.
+ */
+static u32 match_comm_rules(struct task_struct *p, u32 prio)
+{
+	u32 i, j;
 
-	/* For non-pinned tasks, use default CPU selection */
-	cpu = scx_bpf_select_cpu_dfl(p, prev_cpu, wake_flags, &is_idle);
+	bpf_for(i, 0, MAX_COMM_RULES) {
+		struct gamesched_comm_rule *rule;
+		bool match = true;
 
-	/* If selected CPU is isolated and task is not allowed, find another */
-	if (is_cpu_isolated(cpu) && !task_allowed_on_isolated(p)) {
-		s32 nr_cpus = scx_bpf_nr_cpu_ids();
-		s32 i;
-
-		/* Linear scan for a non-isolated CPU */
-		bpf_for(i, 0, nr_cpus) {
-			if (!is_cpu_isolated(i) &&
-			    bpf_cpumask_test_cpu(i, p->cpus_ptr)) {
-				cpu = i;
-				is_idle = scx_bpf_test_and_clear_cpu_idle(cpu);
+		rule = bpf_map_lookup_elem(&comm_rules, &i);
+		if (!rule || !rule->pattern[0])
+			continue;
+
+		bpf_for(j, 0, COMM_LEN) {
+			char c = rule->pattern[j];
+
+			if (!c)
+				break;
+			if (p->comm[j] != c) {
+				match = false;
 				break;
 			}
 		}
-		__sync_fetch_and_add(&nr_isolated_violations, 1);
-	}
 
-	/* Dispatch directly if idle */
-	if (is_idle)
-		scx_bpf_dispatch(p, SCX_DSQ_LOCAL_ON | cpu, slice_ns, 0);
+		if (match)
+			return rule->prio;
+	}
 
-	return cpu;
+	return prio;
 }
 
 /*
- * Enqueue task to appropriate priority DSQ.
+ * Change the effective priority of a task.
  */
-void BPF_STRUCT_OPS(gamesched_enqueue, struct task_struct *p, u64 enq_flags)
+static void set_task_prio(struct task_struct *p, struct task_ctx *tctx,
+			  u32 prio)
 {
-	u32 prio = get_task_priority(p);
-	u64 dsq_id = DSQ_PRIO_BASE + prio;
+	if (prio >= NR_PRIO_LEVELS)
+		prio = PRIO_NORMAL;
 
-	/* Dispatch to the priority-based DSQ */
-	scx_bpf_dispatch(p, dsq_id, slice_ns, enq_flags);
+	/* vtime is only comparable within a level, restart at the new one */
+	if (prio != tctx->prio) {
+		if (tctx->boost_prio < NR_PRIO_LEVELS)
+			tctx->boost_vtime = vtime_now[prio];
+		else
+			p->scx.dsq_vtime = vtime_now[prio];
+	}
 
-	if (prio <= PRIO_GAME_OTHER)
-		__sync_fetch_and_add(&nr_game_dispatched, 1);
+	tctx->prio = prio;
+	if (prio == PRIO_GAME_RENDER || prio == PRIO_GAME_OTHER)
+		tctx->flags |= TASK_F_GAME;
 	else
-		__sync_fetch_and_add(&nr_normal_dispatched, 1);
+		tctx->flags &= ~TASK_F_GAME;
 }
 
 /*
- * Dispatch: consume from DSQs in priority order.
+ * Find the priority of the closest registered ancestor of @cgrp, including
+ * @cgrp itself. Returns NULL if no ancestor is registered.
  */
-void BPF_STRUCT_OPS(gamesched_dispatch, s32 cpu, struct task_struct *prev)
+static u32 *lookup_cgroup_prio(struct cgroup *cgrp)
 {
-	u32 prio;
+	struct cgroup *anc;
+	u32 *prio = NULL;
+	int level, i;
+	u64 cgid;
 
-	/* Consume from DSQs in priority order (0 = highest) */
-	bpf_for(prio, 0, NR_PRIO_LEVELS) {
-		if (scx_bpf_consume(DSQ_PRIO_BASE + prio))
-			return;
+	if (!cgrp)
+		return NULL;
+
+	level = cgrp->level;
+	bpf_for(i, 0, MAX_CGROUP_DEPTH) {
+		if (i > level)
+			break;
+
+		anc = bpf_cgroup_ancestor(cgrp, level - i);
+		if (!anc)
+			break;
+		cgid = anc->kn->id;
+		bpf_cgroup_release(anc);
+
+		prio = bpf_map_lookup_elem(&game_cgroups, &cgid);
+		if (prio)
+			break;
 	}
+
+	return prio;
 }
 
 /*
- * Initialize the scheduler.
+ * Find the named partition owning @p: one owned by its TGID or by @cgrp or
+ * an ancestor of it. Returns 0 if none does.
  */
-s32 BPF_STRUCT_OPS_SLEEPABLE(gamesched_init)
+static u32 owner_partition(struct task_struct *p, struct cgroup *cgrp)
 {
-	s32 ret;
+	struct gamesched_partition *part;
+	struct cgroup *anc;
+	bool match;
 	u32 i;
 
-	/* Create DSQs for each priority level */
-	bpf_for(i, 0, NR_PRIO_LEVELS) {
-		ret = scx_bpf_create_dsq(DSQ_PRIO_BASE + i, -1);
-		if (ret)
-			return ret;
+	if (!has_feature(GAMESCHED_FLAG_ISOLATION))
+		return 0;
+
+	bpf_for(i, 1, MAX_PARTITIONS) {
+		part = bpf_map_lookup_elem(&partitions, &i);
+		if (!part || !part->name[0])
+			continue;
+
+		if (part->owner_tgid) {
+			if (part->owner_tgid == p->tgid)
+				return i;
+			continue;
+		}
+
+		if (!cgrp || !part->owner_cgid || part->cgroup_level > cgrp->level)
+			continue;
+		anc = bpf_cgroup_ancestor(cgrp, part->cgroup_level);
+		if (!anc)
+			continue;
+		match = anc->kn->id == part->owner_cgid;
+		bpf_cgroup_release(anc);
+		if (match)
+			return i;
+	}
+
+	return 0;
+}
+
+/*
+ * Check if a task's live data goes to thread_stats: game, detected and
+ * pinned threads.
+ */
+static bool thread_tracked(const struct task_ctx *tctx)
+{
+	return tctx->base_prio < PRIO_NORMAL || tctx->pinned_cpu >= 0 ||
+	       (tctx->flags & TASK_F_DETECTED);
+}
+
+/*
+ * Refill a task's cached registration state from the userspace maps.
+ * A per-thread registration wins over the thread's TGID registration,
+ * which wins over the registration of its cgroup @cgrp.
+ */
+static void refresh_task_ctx(struct task_struct *p, struct task_ctx *tctx,
+			     u64 gen, struct cgroup *cgrp)
+{
+	u32 pid = p->pid, tgid = p->tgid;
+	u32 detected = tctx->flags & TASK_F_DETECTED;
+	bool tracked = tctx->gen && thread_tracked(tctx);
+	u32 base = PRIO_NORMAL;
+	u32 *prio;
+	s32 *cpu;
+
+	tctx->flags = 0;
+
+	prio = bpf_map_lookup_elem(&game_threads, &pid);
+	if (prio) {
+		base = *prio;
+	} else if ((prio = bpf_map_lookup_elem(&game_tgids, &tgid)) ||
+		   (prio = lookup_cgroup_prio(cgrp))) {
+		base = match_comm_rules(p, *prio);
+		tctx->flags |= TASK_F_GROUP;
+	}
+
+	if (base >= NR_PRIO_LEVELS)
+		base = PRIO_NORMAL;
+	tctx->base_prio = base;
+
+	/* Keep an active detector promotion as long as the task is a member */
+	if (detected && (tctx->flags & TASK_F_GROUP)) {
+		tctx->flags |= TASK_F_DETECTED;
+		set_task_prio(p, tctx, PRIO_GAME_RENDER);
+	} else {
+		if (detected)
+			bpf_map_delete_elem(&detected_threads, &pid);
+		set_task_prio(p, tctx, base);
 	}
 
+	cpu = has_feature(GAMESCHED_FLAG_PINNING) ?
+	      bpf_map_lookup_elem(&pinned_threads, &pid) : NULL;
+	tctx->pinned_cpu = cpu ? *cpu : -1;
+	tctx->partition = owner_partition(p, cgrp);
+
+	/* A deregistered thread drops out of status */
+	if (tracked && !thread_tracked(tctx))
+		bpf_map_delete_elem(&thread_stats, &pid);
+
+	tctx->gen = gen;
+}
+
+/*
+ * Look up the context of a task, refreshing it if the registry changed.
+ * Returns NULL if the task has no context (shouldn't happen after init_task).
+ */
+static struct task_ctx *lookup_task_ctx(struct task_struct *p)
+{
+	struct task_ctx *tctx;
+	u64 gen;
+
+	tctx = bpf_task_storage_get(&task_ctxs, p, 0, 0);
+	if (!tctx)
+		return NULL;
+
+	gen = read_gen(GEN_REGISTRY);
+	if (tctx->gen != gen) {
+		struct cgroup *cgrp = scx_bpf_task_cgroup(p);
+
+		refresh_task_ctx(p, tctx, gen, cgrp);
+		bpf_cgroup_release(cgrp);
+	}
+
+	return tctx;
+}
+
+/*
+ * Get the priority level for a task.
+ * Returns PRIO_NORMAL for unregistered tasks.
+ */
+static u32 get_task_priority(struct task_ctx *tctx)
+{
+	if (!tctx)
+		return PRIO_NORMAL;
+	return tctx->boost_prio < tctx->prio ? tctx->boost_prio : tctx->prio;
+}
+
+
+/*
+ * Rebuild the mask of partition @part from cpu_partition.
+ */
+static void refresh_partition_mask(u32 part)
+{
+	struct partition_ctx *pctx;
+	struct bpf_cpumask *mask;
+	u32 nr_cpus = scx_bpf_nr_cpu_ids();
+	u32 cpu;
+
+	pctx = bpf_map_lookup_elem(&partition_masks, &part);
+	if (!pctx)
+		return;
+
+	mask = bpf_cpumask_create();
+	if (!mask)
+		return;
+
+	bpf_for(cpu, 0, nr_cpus) {
+		if (cpu < MAX_CPUS && cpu_partition[cpu] == part)
+			bpf_cpumask_set_cpu(cpu, mask);
+	}
+
+	mask = bpf_kptr_xchg(&pctx->cpumask, mask);
+	if (mask)
+		bpf_cpumask_release(mask);
+}
+
+/*
+ * Rebuild the isolation cpumasks if userspace changed isolated_cpus.
+ * The new masks are built privately and swapped in, so readers always see
+ * a consistent set.
+ */
+static void refresh_isolation(void)
+{
+	struct bpf_cpumask *iso, *noniso, *unpart;
+	bool enabled = has_feature(GAMESCHED_FLAG_ISOLATION);
+	u64 gen = enabled ? read_gen(GEN_ISOLATION) : 0;
+	u32 nr_cpus = scx_bpf_nr_cpu_ids();
+	u32 cpu, i, nr = 0, nr_part = 0;
+
+	if (gen == isolation_gen)
+		return;
+
+	iso = bpf_cpumask_create();
+	if (!iso)
+		return;
+	noniso = bpf_cpumask_create();
+	if (!noniso) {
+		bpf_cpumask_release(iso);
+		return;
+	}
+	unpart = bpf_cpumask_create();
+	if (!unpart) {
+		bpf_cpumask_release(noniso);
+		bpf_cpumask_release(iso);
+		return;
+	}
+
+	bpf_for(cpu, 0, nr_cpus) {
+		u32 slot = ISOLATION_SLOT(gen, cpu);
+		u32 *isolated = enabled ?
+			bpf_map_lookup_elem(&isolated_cpus, &slot) : NULL;
+		u32 part = isolated && *isolated ? *isolated - 1 : 0;
+
+		if (part >= MAX_PARTITIONS)
+			part = 0;
+		if (cpu < MAX_CPUS)
+			cpu_partition[cpu] = part;
+
+		if (isolated && *isolated) {
+			bpf_cpumask_set_cpu(cpu, iso);
+			nr++;
+		} else {
+			bpf_cpumask_set_cpu(cpu, noniso);
+		}
+
+		if (part)
+			nr_part++;
+		else
+			bpf_cpumask_set_cpu(cpu, unpart);
+	}
+
+	iso = bpf_kptr_xchg(&isolated_mask, iso);
+	if (iso)
+		bpf_cpumask_release(iso);
+	noniso = bpf_kptr_xchg(&nonisolated_mask, noniso);
+	if (noniso)
+		bpf_cpumask_release(noniso);
+	unpart = bpf_kptr_xchg(&unpartitioned_mask, unpart);
+	if (unpart)
+		bpf_cpumask_release(unpart);
+
+	bpf_for(i, 1, MAX_PARTITIONS)
+		refresh_partition_mask(i);
+
+	nr_isolated = nr;
+	nr_partitioned = nr_part;
+	isolation_gen = gen;
+}
+
+/*
+ * Check if a CPU is isolated.
+ */
+static bool is_cpu_isolated(s32 cpu)
+{
+	struct bpf_cpumask *iso;
+	bool ret = false;
+
+	if (cpu < 0 || !isolation_active())
+		return false;
+
+	bpf_rcu_read_lock();
+	iso = isolated_mask;
+	if (iso)
+		ret = bpf_cpumask_test_cpu(cpu, (const struct cpumask *)iso);
+	bpf_rcu_read_unlock();
+
+	return ret;
+}
+
+/*
+ * Get the named partition @cpu belongs to, 0 if none.
+ */
+static u32 cpu_partition_of(s32 cpu)
+{
+	if (cpu < 0 || cpu >= MAX_CPUS || !nr_partitioned ||
+	    !isolation_active())
+		return 0;
+	return cpu_partition[cpu];
+}
+
+/*
+ * Get the LLC index of a CPU.
+ */
+static u32 cpu_llc(s32 cpu)
+{
+	if (cpu < 0 || cpu >= MAX_CPUS)
+		return 0;
+	return cpu_llc_id[cpu];
+}
+
+/*
+ * Get the DSQ of priority level @prio in the shard of LLC @llc.
+ */
+static u64 llc_dsq(u32 llc, u32 prio)
+{
+	return DSQ_LLC_BASE + llc * NR_PRIO_LEVELS + prio;
+}
+
+/*
+ * Get the DSQ a task of priority @prio headed for @cpu is queued on.
+ */
+static u64 prio_dsq(u32 prio, s32 cpu)
+{
+	if (llc_shards)
+		return llc_dsq(cpu_llc(cpu), prio);
+	return DSQ_PRIO_BASE + prio;
+}
+
+/*
+ * Get the DSQ of priority level @prio of named partition @part.
+ */
+static u64 part_dsq(u32 part, u32 prio)
+{
+	return DSQ_PART_BASE + part * NR_PRIO_LEVELS + prio;
+}
+
+/*
+ * Get the queue_served_at slot of the @prio queue of @llc.
+ */
+static u32 queue_slot(u32 llc, u32 prio)
+{
+	if (!llc_shards)
+		llc = 0;
+	return (llc * NR_PRIO_LEVELS + prio) % (MAX_LLCS * NR_PRIO_LEVELS);
+}
+
+/*
+ * Record that the @prio queue of @llc made progress.
+ */
+static void mark_served(u32 llc, u32 prio)
+{
+	if (starve_age_ns && prio < NR_PRIO_LEVELS)
+		queue_served_at[queue_slot(llc, prio)] = bpf_ktime_get_ns();
+}
+
+/*
+ * Check if game work is waiting for @cpu: its pinned DSQ, or the game
+ * levels of the priority DSQs it consumes first.
+ */
+static bool game_work_queued(s32 cpu)
+{
+	u32 part = cpu_partition_of(cpu);
+
+	if (part)
+		return scx_bpf_dsq_nr_queued(part_dsq(part, PRIO_GAME_RENDER)) ||
+		       scx_bpf_dsq_nr_queued(part_dsq(part, PRIO_GAME_OTHER));
+
+	return (has_feature(GAMESCHED_FLAG_PINNING) &&
+		scx_bpf_dsq_nr_queued(DSQ_CPU_BASE + cpu)) ||
+	       scx_bpf_dsq_nr_queued(prio_dsq(PRIO_GAME_RENDER, cpu)) ||
+	       scx_bpf_dsq_nr_queued(prio_dsq(PRIO_GAME_OTHER, cpu));
+}
+
+/*
+ * Get the time slice for a task of priority @prio about to run on @cpu.
+ * In adaptive mode normal and background tasks get at most slice_min_ns
+ * while game work is waiting.
+ */
+static u64 task_slice(u32 prio, s32 cpu)
+{
+	u64 prio_slice = prio < NR_PRIO_LEVELS ? prio_slice_ns[prio] : 0;
+	bool game_waiting;
+
+	/* Only look at the queues when the slice may actually be cut */
+	game_waiting = adaptive_slice && prio >= PRIO_NORMAL &&
+		       game_work_queued(cpu);
+
+	return policy_slice(prio, slice_ns, prio_slice,
+			    adaptive_slice ? slice_min_ns : 0, game_waiting);
+}
+
+/*
+ * Lift a freshly woken task to the class of the game thread waking it.
+ * Boosted tasks get a vtime at the front of the borrowed level and keep
+ * their own one to return to.
+ */
+static void boost_wakee(struct task_struct *p, struct task_ctx *tctx,
+			u64 wake_flags)
+{
+	struct task_struct *waker;
+	struct task_ctx *wctx;
+	u32 prio;
+
+	if (!boost_wakees || !tctx || !(wake_flags & SCX_WAKE_TTWU))
+		return;
+
+	waker = bpf_get_current_task_btf();
+	if (waker == p)
+		return;
+
+	wctx = bpf_task_storage_get(&task_ctxs, waker, 0, 0);
+	prio = get_task_priority(wctx);
+	if (prio >= PRIO_NORMAL || prio >= get_task_priority(tctx))
+		return;
+
+	if (tctx->boost_prio >= NR_PRIO_LEVELS)
+		tctx->boost_vtime = p->scx.dsq_vtime;
+	tctx->boost_prio = prio;
+	tctx->boosted_until = bpf_ktime_get_ns() + task_slice(prio, -1);
+	p->scx.dsq_vtime = vtime_now[prio];
+	STAT_INC(nr_boosts);
+}
+
+/*
+ * End a wakee boost, carrying the vtime charged while boosted over to the
+ * task's own level.
+ */
+static void clear_boost(struct task_struct *p, struct task_ctx *tctx)
+{
+	u32 prio = tctx->boost_prio;
+
+	if (prio >= NR_PRIO_LEVELS)
+		return;
+
+	if (vtime_before(vtime_now[prio], p->scx.dsq_vtime))
+		tctx->boost_vtime += p->scx.dsq_vtime - vtime_now[prio];
+	p->scx.dsq_vtime = tctx->boost_vtime;
+	tctx->boost_prio = NR_PRIO_LEVELS;
+}
+
+/*
+ * Get the cpumask of the LLC @cpu belongs to, or NULL.
+ * Must be called under RCU.
+ */
+static const struct cpumask *lookup_llc_mask(s32 cpu)
+{
+	struct llc_ctx *lctx;
+	u32 llc;
+
+	if (cpu < 0 || cpu >= MAX_CPUS)
+		return NULL;
+
+	llc = cpu_llc_id[cpu];
+	lctx = bpf_map_lookup_elem(&llc_masks, &llc);
+	if (!lctx || !lctx->cpumask)
+		return NULL;
+
+	return (const struct cpumask *)lctx->cpumask;
+}
+
+/*
+ * Check if a task is allowed on an isolated CPU.
+ * Game threads (any priority) are allowed on isolated CPUs.
+ */
+static bool task_allowed_on_isolated(struct task_struct *p,
+				     struct task_ctx *tctx)
+{
+	/* Game threads are allowed */
+	if (tctx && (tctx->flags & TASK_F_GAME))
+		return true;
+
+	/*
+	 * Kernel threads are allowed (RT, percpu, etc.), in strict mode only
+	 * those that can't run anywhere else
+	 */
+	if (p->flags & PF_KTHREAD)
+		return !strict_isolation || p->nr_cpus_allowed == 1;
+
+	return false;
+}
+
+/*
+ * Check if a non-game task headed for an isolated CPU has to run there
+ * anyway: it's allowed on isolated CPUs, or its affinity leaves no
+ * non-isolated CPU to steer it to.
+ */
+static bool must_run_on_isolated(struct task_struct *p, struct task_ctx *tctx)
+{
+	struct bpf_cpumask *noniso;
+	bool ret = true;
+
+	if (task_allowed_on_isolated(p, tctx))
+		return true;
+
+	bpf_rcu_read_lock();
+	noniso = nonisolated_mask;
+	if (noniso)
+		ret = !bpf_cpumask_intersects(p->cpus_ptr,
+					      (const struct cpumask *)noniso);
+	bpf_rcu_read_unlock();
+
+	return ret;
+}
+
+/*
+ * Get the named partition a task is confined to, or 0. Only game tasks
+ * are, and only while their affinity overlaps the partition's CPUs.
+ */
+static u32 task_partition(struct task_struct *p, struct task_ctx *tctx)
+{
+	struct partition_ctx *pctx;
+	bool ret = false;
+	u32 part;
+
+	if (!nr_partitioned || !isolation_active() || !tctx ||
+	    !(tctx->flags & TASK_F_GAME))
+		return 0;
+
+	part = tctx->partition;
+	if (!part || part >= MAX_PARTITIONS)
+		return 0;
+
+	pctx = bpf_map_lookup_elem(&partition_masks, &part);
+	if (!pctx)
+		return 0;
+
+	bpf_rcu_read_lock();
+	if (pctx->cpumask)
+		ret = bpf_cpumask_intersects(p->cpus_ptr,
+					     (const struct cpumask *)pctx->cpumask);
+	bpf_rcu_read_unlock();
+
+	return ret ? part : 0;
+}
+
+/*
+ * Check if isolation lets a task run on @cpu: non-isolated CPUs take
+ * anything, isolated ones the tasks allowed there, except that the CPUs
+ * of a named partition only take the game tasks it owns.
+ */
+static bool task_allowed_on_cpu(struct task_struct *p, struct task_ctx *tctx,
+				s32 cpu)
+{
+	if (!is_cpu_isolated(cpu))
+		return true;
+	if (!task_allowed_on_isolated(p, tctx))
+		return false;
+	if (!tctx || !(tctx->flags & TASK_F_GAME))
+		return true;
+	return cpu_partition_of(cpu) == task_partition(p, tctx);
+}
+
+/*
+ * Get the pinned CPU for a task, or -1 if not pinned.
+ * Pins to CPUs outside the task's affinity, or to the CPUs of a named
+ * partition that doesn't own the task, are ignored.
+ */
+static s32 get_pinned_cpu(struct task_struct *p, struct task_ctx *tctx)
+{
+	u32 part;
+	s32 cpu;
+
+	if (!has_feature(GAMESCHED_FLAG_PINNING) || !tctx)
+		return -1;
+
+	cpu = tctx->pinned_cpu;
+	if (cpu < 0 || cpu >= scx_bpf_nr_cpu_ids() ||
+	    !bpf_cpumask_test_cpu(cpu, p->cpus_ptr))
+		return -1;
+
+	part = cpu_partition_of(cpu);
+	if (part && part != tctx->partition)
+		return -1;
+
+	return cpu;
+}
+
+/*
+ * Pick a CPU of partition @part for a task it owns: an idle one, trying
+ * @prev_cpu and then whole idle cores first, else @prev_cpu if it belongs
+ * to the partition, else any partition CPU the task may use. Returns -1
+ * if there is none.
+ */
+static s32 pick_partition_cpu(struct task_struct *p, struct task_ctx *tctx,
+			      u32 part, s32 prev_cpu, bool *is_idle)
+{
+	struct partition_ctx *pctx;
+	struct bpf_cpumask *tmp;
+	s32 cpu = -1, idle;
+
+	*is_idle = false;
+
+	pctx = bpf_map_lookup_elem(&partition_masks, &part);
+	if (!pctx || !tctx)
+		return -1;
+
+	bpf_rcu_read_lock();
+
+	tmp = tctx->tmp_mask;
+	if (!tmp || !pctx->cpumask ||
+	    !bpf_cpumask_and(tmp, p->cpus_ptr,
+			     (const struct cpumask *)pctx->cpumask))
+		goto out;
+
+	if (prev_cpu >= 0 &&
+	    bpf_cpumask_test_cpu(prev_cpu, (const struct cpumask *)tmp)) {
+		cpu = prev_cpu;
+		if (scx_bpf_test_and_clear_cpu_idle(prev_cpu)) {
+			*is_idle = true;
+			goto out;
+		}
+	}
+
+	idle = scx_bpf_pick_idle_cpu((const struct cpumask *)tmp,
+				     SCX_PICK_IDLE_CORE);
+	if (idle < 0)
+		idle = scx_bpf_pick_idle_cpu((const struct cpumask *)tmp, 0);
+	if (idle >= 0) {
+		cpu = idle;
+		*is_idle = true;
+		goto out;
+	}
+
+	if (cpu < 0) {
+		cpu = bpf_cpumask_any_distribute((const struct cpumask *)tmp);
+		if (cpu >= scx_bpf_nr_cpu_ids())
+			cpu = -1;
+	}
+out:
+	bpf_rcu_read_unlock();
+	return cpu;
+}
+
+/*
+ * Claim an idle CPU outside the named partitions for a task that isn't
+ * owned by one. Returns -1 if none is idle.
+ */
+static s32 pick_idle_shared_cpu(struct task_struct *p, struct task_ctx *tctx)
+{
+	struct bpf_cpumask *tmp, *unpart;
+	s32 cpu = -1;
+
+	if (!nr_partitioned || !isolation_active())
+		return scx_bpf_pick_idle_cpu(p->cpus_ptr, 0);
+	if (!tctx)
+		return -1;
+
+	bpf_rcu_read_lock();
+	tmp = tctx->tmp_mask;
+	unpart = unpartitioned_mask;
+	if (tmp && unpart &&
+	    bpf_cpumask_and(tmp, p->cpus_ptr, (const struct cpumask *)unpart))
+		cpu = scx_bpf_pick_idle_cpu((const struct cpumask *)tmp, 0);
+	bpf_rcu_read_unlock();
+
+	return cpu;
+}
+
+/*
+ * Pick a non-isolated CPU for a task that isn't allowed on isolated CPUs.
+ * Prefers an idle CPU in (allowed & non-isolated), then any such CPU sharing
+ * the LLC of @prev_cpu, then any such CPU at all. Returns -1 if the task
+ * can't run anywhere outside the isolated set.
+ */
+static s32 pick_nonisolated_cpu(struct task_struct *p, struct task_ctx *tctx,
+				s32 prev_cpu, bool *is_idle)
+{
+	struct bpf_cpumask *tmp, *noniso;
+	const struct cpumask *llc;
+	s32 cpu = -1;
+
+	*is_idle = false;
+
+	if (!tctx)
+		return -1;
+
+	bpf_rcu_read_lock();
+
+	tmp = tctx->tmp_mask;
+	noniso = nonisolated_mask;
+	if (!tmp || !noniso)
+		goto out;
+
+	if (!bpf_cpumask_and(tmp, p->cpus_ptr, (const struct cpumask *)noniso))
+		goto out;
+
+	cpu = scx_bpf_pick_idle_cpu((const struct cpumask *)tmp, 0);
+	if (cpu >= 0) {
+		*is_idle = true;
+		goto out;
+	}
+
+	/* Nothing idle, stay close to the cache the task last ran on */
+	llc = lookup_llc_mask(prev_cpu);
+	if (llc && bpf_cpumask_intersects((const struct cpumask *)tmp, llc))
+		cpu = bpf_cpumask_any_and_distribute((const struct cpumask *)tmp, llc);
+	else
+		cpu = bpf_cpumask_any_distribute((const struct cpumask *)tmp);
+
+	if (cpu >= scx_bpf_nr_cpu_ids())
+		cpu = -1;
+out:
+	bpf_rcu_read_unlock();
+	return cpu;
+}
+
+/*
+ * Get the context of @cpu.
+ */
+static struct cpu_ctx *lookup_cpu_ctx(s32 cpu)
+{
+	u32 zero = 0;
+
+	if (cpu < 0)
+		return bpf_map_lookup_elem(&cpu_ctxs, &zero);
+	return bpf_map_lookup_percpu_elem(&cpu_ctxs, &zero, cpu);
+}
+
+/*
+ * Get the placement domain of a @prio task.
+ */
+static u32 prio_domain(u32 prio)
+{
+	return prio < PRIO_NORMAL ? DOM_GAME : DOM_SYSTEM;
+}
+
+/*
+ * Get the CPU capacity class a @prio task prefers under hybrid steering.
+ */
+static u32 prio_capacity(u32 prio)
+{
+	if (!hybrid_steering || !nr_little_cpus)
+		return CAP_ANY;
+	if (prio < PRIO_NORMAL)
+		return CAP_BIG;
+	if (prio == PRIO_BACKGROUND)
+		return CAP_LITTLE;
+	return CAP_ANY;
+}
+
+/*
+ * Check if the CPUs of capacity class @cap are saturated: more work of that
+ * class is queued (on @cpu's shard) than there are CPUs in the class.
+ */
+static bool capacity_pressure(u32 cap, s32 cpu)
+{
+	if (cap == CAP_BIG)
+		return scx_bpf_dsq_nr_queued(prio_dsq(PRIO_GAME_RENDER, cpu)) +
+		       scx_bpf_dsq_nr_queued(prio_dsq(PRIO_GAME_OTHER, cpu)) >=
+		       nr_big_cpus;
+	if (cap == CAP_LITTLE)
+		return scx_bpf_dsq_nr_queued(prio_dsq(PRIO_BACKGROUND, cpu)) >=
+		       nr_little_cpus;
+	return true;
+}
+
+/*
+ * Check if @cpu is of a different capacity class than @prio tasks prefer.
+ */
+static bool capacity_mismatch(s32 cpu, u32 prio)
+{
+	struct cpu_ctx *cctx;
+	u32 cap = prio_capacity(prio);
+
+	if (cap == CAP_ANY)
+		return false;
+
+	cctx = lookup_cpu_ctx(cpu);
+	return cctx && cctx->big != (cap == CAP_BIG);
+}
+
+/*
+ * Check if @cpu should consume queued @prio work: work of its own class,
+ * or of the other class once that one is saturated.
+ */
+static bool cpu_takes_level(s32 cpu, u32 prio)
+{
+	return !capacity_mismatch(cpu, prio) ||
+	       capacity_pressure(prio_capacity(prio), cpu);
+}
+
+/*
+ * Check if @p may run on any CPU of the capacity class it prefers.
+ */
+static bool affinity_has_capacity(struct task_struct *p, u32 prio)
+{
+	struct bpf_cpumask *mask;
+	u32 cap = prio_capacity(prio);
+	bool ret = true;
+
+	if (cap == CAP_ANY)
+		return true;
+
+	bpf_rcu_read_lock();
+	mask = cap == CAP_BIG ? big_mask : little_mask;
+	if (mask)
+		ret = bpf_cpumask_intersects(p->cpus_ptr,
+					     (const struct cpumask *)mask);
+	bpf_rcu_read_unlock();
+
+	return ret;
+}
+
+/*
+ * Claim an idle CPU for a @prio task among the CPUs it prefers: its
+ * placement domain and, under hybrid steering, its capacity class when it
+ * may run there. @prev_cpu is tried first, then whole idle cores. Tasks
+ * that may not run on isolated CPUs only look at non-isolated ones, the
+ * others at the CPUs outside the named partitions.
+ * Returns -1 if none is idle.
+ */
+static s32 pick_preferred_cpu(struct task_struct *p, struct task_ctx *tctx,
+			      u32 prio, s32 prev_cpu)
+{
+	struct bpf_cpumask *tmp, *dom, *capmask, *allowed;
+	u32 cap = prio_capacity(prio);
+	s32 cpu = -1;
+
+	if (!tctx)
+		return -1;
+
+	bpf_rcu_read_lock();
+
+	tmp = tctx->tmp_mask;
+	dom = prio_domain(prio) == DOM_GAME ? game_domain_mask :
+					      system_domain_mask;
+	capmask = cap == CAP_BIG ? big_mask : little_mask;
+	allowed = task_allowed_on_isolated(p, tctx) ? unpartitioned_mask :
+						      nonisolated_mask;
+	if (!tmp || !dom || !capmask || !allowed)
+		goto out;
+
+	bpf_cpumask_copy(tmp, p->cpus_ptr);
+	if (domains_enabled &&
+	    !bpf_cpumask_and(tmp, (const struct cpumask *)tmp,
+			     (const struct cpumask *)dom))
+		goto out;
+	if (cap != CAP_ANY &&
+	    bpf_cpumask_intersects((const struct cpumask *)tmp,
+				   (const struct cpumask *)capmask))
+		bpf_cpumask_and(tmp, (const struct cpumask *)tmp,
+				(const struct cpumask *)capmask);
+	if (isolation_active() &&
+	    !bpf_cpumask_and(tmp, (const struct cpumask *)tmp,
+			     (const struct cpumask *)allowed))
+		goto out;
+
+	if (prev_cpu >= 0 &&
+	    bpf_cpumask_test_cpu(prev_cpu, (const struct cpumask *)tmp) &&
+	    scx_bpf_test_and_clear_cpu_idle(prev_cpu)) {
+		cpu = prev_cpu;
+		goto out;
+	}
+
+	cpu = scx_bpf_pick_idle_cpu((const struct cpumask *)tmp,
+				    SCX_PICK_IDLE_CORE);
+	if (cpu < 0)
+		cpu = scx_bpf_pick_idle_cpu((const struct cpumask *)tmp, 0);
+out:
+	bpf_rcu_read_unlock();
+	return cpu;
+}
+
+/*
+ * Count a @prio task placed on @cpu outside its placement domain.
+ */
+static void count_domain_spill(u32 prio, s32 cpu)
+{
+	u32 dom = prio_domain(prio);
+
+	if (cpu < 0 || cpu >= MAX_CPUS || cpu_domain[cpu] == dom)
+		return;
+
+	if (dom < NR_DOMAINS)
+		STAT_INC(nr_domain_spills[dom]);
+}
+
+/*
+ * Get the SMT sibling of @cpu, or -1.
+ */
+static s32 smt_sibling(s32 cpu)
+{
+	s32 sib;
+
+	if (cpu < 0 || cpu >= MAX_CPUS)
+		return -1;
+
+	sib = cpu_sibling[cpu];
+	if (sib == cpu || sib >= (s32)scx_bpf_nr_cpu_ids())
+		return -1;
+	return sib;
+}
+
+/*
+ * Check if @cpu has to stay idle because its SMT sibling is an isolated
+ * CPU running a render task. Pinned threads are exempt: select_cpu and
+ * dispatch place them on their CPU without asking, as the user pinned
+ * them there on purpose.
+ */
+static bool sibling_quiet(s32 cpu)
+{
+	struct cpu_ctx *cctx;
+	s32 sib;
+
+	if (!quiet_siblings)
+		return false;
+
+	sib = smt_sibling(cpu);
+	if (sib < 0 || !is_cpu_isolated(sib))
+		return false;
+
+	cctx = lookup_cpu_ctx(sib);
+	return cctx && cctx->cur_prio == PRIO_GAME_RENDER;
+}
+
+/*
+ * Check if @cpu runs something a @prio task should preempt.
+ */
+static bool cpu_preemptible(s32 cpu, u32 prio)
+{
+	struct cpu_ctx *cctx = lookup_cpu_ctx(cpu);
+
+	return cctx && policy_better_victim(cctx->cur_prio, prio);
+}
+
+/*
+ * Make room for a freshly queued task of priority @prio whose policy allows
+ * preemption. Wakes an idle CPU if there is one, otherwise kicks the allowed
+ * CPU running the lowest-priority task. In LLC mode only render tasks, which
+ * are stolen eagerly, look beyond the LLC the task was queued on.
+ */
+static bool try_preempt(struct task_struct *p, struct task_ctx *tctx,
+			u32 prio, s32 task_cpu)
+{
+	u32 nr_cpus = scx_bpf_nr_cpu_ids();
+	u32 victim_prio = prio;
+	bool any_class = true;
+	s32 cpu, victim = -1;
+
+	if (!policy_may_preempt(preempt_prios, prio))
+		return false;
+
+	/* Under hybrid steering, stay on the preferred class until saturated */
+	if (prio_capacity(prio) != CAP_ANY && affinity_has_capacity(p, prio))
+		any_class = capacity_pressure(prio_capacity(prio), task_cpu);
+
+	cpu = any_class ? pick_idle_shared_cpu(p, tctx) :
+			  pick_preferred_cpu(p, tctx, prio, -1);
+	if (cpu >= 0) {
+		scx_bpf_kick_cpu(cpu, SCX_KICK_IDLE);
+		return false;
+	}
+
+	bpf_for(cpu, 0, nr_cpus) {
+		struct cpu_ctx *cctx;
+
+		if (!bpf_cpumask_test_cpu(cpu, p->cpus_ptr))
+			continue;
+		if (llc_shards && prio != PRIO_GAME_RENDER &&
+		    cpu_llc(cpu) != cpu_llc(task_cpu))
+			continue;
+		if (!any_class && capacity_mismatch(cpu, prio))
+			continue;
+		if (cpu_partition_of(cpu))
+			continue;
+
+		cctx = lookup_cpu_ctx(cpu);
+		if (!cctx || !policy_better_victim(cctx->cur_prio, victim_prio))
+			continue;
+
+		victim = cpu;
+		victim_prio = cctx->cur_prio;
+		if (victim_prio == PRIO_BACKGROUND)
+			break;
+	}
+
+	if (victim < 0)
+		return false;
+
+	scx_bpf_kick_cpu(victim, SCX_KICK_PREEMPT);
+	STAT_INC(nr_preemptions);
+	return true;
+}
+
+/*
+ * Make room on partition @part for a freshly queued @prio task it owns:
+ * wake an idle partition CPU, or kick the one running the lowest-priority
+ * task if the policy allows preemption.
+ */
+static bool kick_partition(struct task_struct *p, struct task_ctx *tctx,
+			   u32 part, u32 prio)
+{
+	u32 nr_cpus = scx_bpf_nr_cpu_ids();
+	u32 victim_prio = prio;
+	s32 cpu, victim = -1;
+	bool is_idle;
+
+	cpu = pick_partition_cpu(p, tctx, part, -1, &is_idle);
+	if (is_idle) {
+		scx_bpf_kick_cpu(cpu, SCX_KICK_IDLE);
+		return false;
+	}
+
+	if (!policy_may_preempt(preempt_prios, prio))
+		return false;
+
+	bpf_for(cpu, 0, nr_cpus) {
+		struct cpu_ctx *cctx;
+
+		if (cpu_partition_of(cpu) != part ||
+		    !bpf_cpumask_test_cpu(cpu, p->cpus_ptr))
+			continue;
+
+		cctx = lookup_cpu_ctx(cpu);
+		if (!cctx || !policy_better_victim(cctx->cur_prio, victim_prio))
+			continue;
+
+		victim = cpu;
+		victim_prio = cctx->cur_prio;
+	}
+
+	if (victim < 0)
+		return false;
+
+	scx_bpf_kick_cpu(victim, SCX_KICK_PREEMPT);
+	STAT_INC(nr_preemptions);
+	return true;
+}
+
+/*
+ * Count a wakeup of @p steered off the CPU first selected for it.
+ */
+static void count_redirect(struct task_struct *p)
+{
+	struct gamesched_thread_stats *ts;
+	u32 pid = p->pid;
+
+	ts = bpf_map_lookup_elem(&thread_stats, &pid);
+	if (ts)
+		__sync_fetch_and_add(&ts->nr_redirects, 1);
+}
+
+/*
+ * Select CPU for a task.
+ * - Pinned game threads go to their pinned CPU
+ * - Game tasks of a named partition stay on its CPUs
+ * - Normal tasks avoid isolated CPUs
+ */
+s32 BPF_STRUCT_OPS(gamesched_select_cpu, struct task_struct *p,
+		   s32 prev_cpu, u64 wake_flags)
+{
+	struct task_ctx *tctx = lookup_task_ctx(p);
+	u32 reason = TRACE_R_NONE;
+	s32 pinned_cpu;
+	bool is_idle = false;
+	u32 prio, cap, part;
+	s32 cpu;
+
+	boost_wakee(p, tctx, wake_flags);
+	prio = get_task_priority(tctx);
+
+	/* Check if this task is pinned to a specific CPU */
+	pinned_cpu = get_pinned_cpu(p, tctx);
+	if (pinned_cpu >= 0) {
+		/* Try to dispatch directly if the pinned CPU is idle */
+		if (scx_bpf_test_and_clear_cpu_idle(pinned_cpu)) {
+			scx_bpf_dispatch(p, SCX_DSQ_LOCAL_ON | pinned_cpu,
+					 task_slice(prio, pinned_cpu), 0);
+			STAT_INC(nr_direct_dispatched);
+		}
+		trace_event(p, TRACE_SELECT, prio, pinned_cpu, TRACE_R_PINNED, 0);
+		return pinned_cpu;
+	}
+
+	refresh_isolation();
+
+	part = task_partition(p, tctx);
+	if (part) {
+		cpu = pick_partition_cpu(p, tctx, part, prev_cpu, &is_idle);
+		if (cpu >= 0)
+			goto found;
+		part = 0;
+	}
+
+	/* Prefer an idle CPU of the task's placement domain and class */
+	cap = prio_capacity(prio);
+	if (domains_enabled || cap != CAP_ANY) {
+		cpu = pick_preferred_cpu(p, tctx, prio, prev_cpu);
+		if (cpu >= 0) {
+			is_idle = true;
+			goto found;
+		}
+	}
+
+	if (cap != CAP_ANY && affinity_has_capacity(p, prio) &&
+	    !capacity_pressure(cap, prev_cpu)) {
+		/* Wait for a CPU of the preferred class instead of taking another */
+		cpu = prev_cpu;
+	} else {
+		/* For non-pinned tasks, use default CPU selection */
+		cpu = scx_bpf_select_cpu_dfl(p, prev_cpu, wake_flags, &is_idle);
+	}
+
+	/* If selected CPU is isolated and task is not allowed, find another */
+	if (!task_allowed_on_cpu(p, tctx, cpu)) {
+		s32 target;
+
+		target = pick_nonisolated_cpu(p, tctx, prev_cpu, &is_idle);
+		if (target >= 0)
+			cpu = target;
+		STAT_INC(nr_isolated_violations);
+		count_redirect(p);
+		reason = TRACE_R_REDIRECT;
+	}
+
+	if (domains_enabled)
+		count_domain_spill(prio, cpu);
+found:
+	/* Don't wake a sibling that has to stay quiet */
+	if (is_idle && sibling_quiet(cpu))
+		is_idle = false;
+
+	/* Dispatch directly if idle */
+	if (is_idle) {
+		scx_bpf_dispatch(p, SCX_DSQ_LOCAL_ON | cpu,
+				 task_slice(prio, cpu), 0);
+		STAT_INC(nr_direct_dispatched);
+		if (part)
+			PART_STAT_INC(part, nr_direct);
+		if (reason == TRACE_R_NONE)
+			reason = TRACE_R_DIRECT;
+	}
+
+	trace_event(p, TRACE_SELECT, prio, cpu, reason, 0);
+	return cpu;
+}
+
+/*
+ * Queue a task on the DSQ of priority level @prio for @cpu, or of named
+ * partition @part if set, ordered by weighted vtime in vtime mode and FIFO
+ * otherwise.
+ */
+static void dispatch_prio(struct task_struct *p, u32 part, u32 prio, s32 cpu,
+			  u64 enq_flags)
+{
+	u64 dsq_id = part ? part_dsq(part, prio) : prio_dsq(prio, cpu);
+	u64 slice = task_slice(prio, cpu);
+	u64 vtime = p->scx.dsq_vtime;
+
+	/* A queue starts aging when its first task arrives */
+	if (!part && !scx_bpf_dsq_nr_queued(dsq_id))
+		mark_served(cpu_llc(cpu), prio);
+
+	if (!vtime_enabled || prio >= NR_PRIO_LEVELS) {
+		scx_bpf_dispatch(p, dsq_id, slice, enq_flags);
+		return;
+	}
+
+	/*
+	 * Limit the budget a task can bank while sleeping to one slice, so
+	 * short-burst threads wake up ahead of CPU hogs without being able to
+	 * starve them.
+	 */
+	if (vtime_before(vtime, vtime_now[prio] - slice_ns))
+		vtime = vtime_now[prio] - slice_ns;
+
+	scx_bpf_dispatch_vtime(p, dsq_id, slice, vtime, enq_flags);
+}
+
+/*
+ * Enqueue task to appropriate priority DSQ.
+ */
+void BPF_STRUCT_OPS(gamesched_enqueue, struct task_struct *p, u64 enq_flags)
+{
+	struct task_ctx *tctx = lookup_task_ctx(p);
+	u32 prio = get_task_priority(tctx);
+	s32 cpu = scx_bpf_task_cpu(p);
+	u32 reason = TRACE_R_NONE;
+	s32 pinned_cpu;
+	u32 part;
+
+	refresh_isolation();
+
+	pinned_cpu = get_pinned_cpu(p, tctx);
+	if (pinned_cpu >= 0) {
+		reason = TRACE_R_PINNED;
+		/* Only the pinned CPU consumes its DSQ, so the task can't drift */
+		scx_bpf_dispatch(p, DSQ_CPU_BASE + pinned_cpu,
+				 task_slice(prio, pinned_cpu), enq_flags);
+		if (policy_may_preempt(preempt_prios, prio) &&
+		    cpu_preemptible(pinned_cpu, prio)) {
+			scx_bpf_kick_cpu(pinned_cpu, SCX_KICK_PREEMPT);
+			STAT_INC(nr_preemptions);
+		} else {
+			scx_bpf_kick_cpu(pinned_cpu, SCX_KICK_IDLE);
+		}
+	} else if ((part = task_partition(p, tctx))) {
+		/* Only the partition's CPUs consume its DSQs */
+		dispatch_prio(p, part, prio, cpu, enq_flags);
+		PART_STAT_INC(part, nr_enqueued);
+		if (kick_partition(p, tctx, part, prio))
+			reason = TRACE_R_PREEMPT;
+	} else if (prio >= PRIO_NORMAL && is_cpu_isolated(cpu)) {
+		/*
+		 * Isolated CPUs never consume the normal/background DSQs, so a
+		 * task that has to run on this one goes to its local DSQ.
+		 */
+		if (must_run_on_isolated(p, tctx)) {
+			scx_bpf_dispatch(p, SCX_DSQ_LOCAL_ON | cpu,
+					 task_slice(prio, cpu), enq_flags);
+			scx_bpf_kick_cpu(cpu, SCX_KICK_IDLE);
+			reason = TRACE_R_LOCAL;
+		} else {
+			dispatch_prio(p, 0, prio, cpu, enq_flags);
+		}
+	} else if (!affinity_has_capacity(p, prio)) {
+		/*
+		 * Hybrid: the CPUs this task may use hold back work of its
+		 * class until saturated, queue it on its CPU instead.
+		 */
+		scx_bpf_dispatch(p, SCX_DSQ_LOCAL_ON | cpu,
+				 task_slice(prio, cpu), enq_flags);
+		scx_bpf_kick_cpu(cpu, SCX_KICK_IDLE);
+		reason = TRACE_R_LOCAL;
+	} else if ((enq_flags & SCX_ENQ_LAST) &&
+		   task_allowed_on_cpu(p, tctx, cpu) && !sibling_quiet(cpu)) {
+		/* Nothing else is runnable here, keep running on this CPU */
+		scx_bpf_dispatch(p, SCX_DSQ_LOCAL, task_slice(prio, cpu),
+				 enq_flags);
+		reason = TRACE_R_LOCAL;
+	} else {
+		/*
+		 * The last runnable task of a CPU that was isolated (or given
+		 * to another partition) since it got there has to move off it.
+		 * So does one whose sibling went quiet, that's no violation.
+		 */
+		if ((enq_flags & SCX_ENQ_LAST) &&
+		    !task_allowed_on_cpu(p, tctx, cpu)) {
+			STAT_INC(nr_isolated_violations);
+			reason = TRACE_R_REDIRECT;
+		}
+
+		/* Dispatch to the priority-based DSQ */
+		dispatch_prio(p, 0, prio, cpu, enq_flags);
+		if (try_preempt(p, tctx, prio, cpu))
+			reason = TRACE_R_PREEMPT;
+	}
+
+	if (prio < NR_PRIO_LEVELS)
+		STAT_INC(nr_enqueued[prio]);
+	trace_event(p, TRACE_ENQUEUE, prio,
+		    pinned_cpu >= 0 ? pinned_cpu : cpu, reason, 0);
+}
+
+/*
+ * LLC mode: steal a task of priority @prio from the shard of another LLC,
+ * scanning the other LLCs round-robin starting after @local_llc.
+ */
+static bool consume_remote(u32 prio, u32 local_llc)
+{
+	u32 i;
+
+	bpf_for(i, 1, nr_llcs) {
+		u32 llc = (local_llc + i) % nr_llcs;
+
+		if (scx_bpf_consume(llc_dsq(llc, prio))) {
+			mark_served(llc, prio);
+			STAT_INC(nr_stolen_dispatched);
+			if (prio < NR_PRIO_LEVELS)
+				STAT_INC(nr_dispatched[prio]);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * LLC mode: consume from the local shard in priority order, stealing from
+ * other LLCs only once the local shard is empty. Render work is the
+ * exception: it's stolen before falling through to lower local levels.
+ * Only the first @nr_levels priority levels are considered.
+ */
+static bool dispatch_llc(s32 cpu, u32 nr_levels)
+{
+	u32 llc = cpu_llc(cpu);
+	u32 prio;
+
+	bpf_for(prio, 0, nr_levels) {
+		if (!cpu_takes_level(cpu, prio))
+			continue;
+		if (scx_bpf_consume(llc_dsq(llc, prio))) {
+			mark_served(llc, prio);
+			STAT_INC(nr_local_dispatched);
+			if (prio < NR_PRIO_LEVELS)
+				STAT_INC(nr_dispatched[prio]);
+			if (capacity_mismatch(cpu, prio))
+				STAT_INC(nr_capacity_fallbacks);
+			return true;
+		}
+		if (prio == PRIO_GAME_RENDER && consume_remote(prio, llc))
+			return true;
+	}
+
+	bpf_for(prio, PRIO_GAME_OTHER, nr_levels) {
+		if (cpu_takes_level(cpu, prio) && consume_remote(prio, llc))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Starvation guard: serve a normal or background queue ahead of waiting
+ * game work if it has waited too long, or if its class is behind its
+ * share of @cpu in the current budget window. Without game work waiting,
+ * priority order serves those queues anyway.
+ */
+static bool dispatch_starved(s32 cpu, u32 nr_levels)
+{
+	struct cpu_ctx *cctx = lookup_cpu_ctx(-1);
+	u32 llc = cpu_llc(cpu);
+	u64 now = bpf_ktime_get_ns();
+	u64 elapsed;
+	u32 prio;
+
+	if (!cctx)
+		return false;
+
+	elapsed = now - cctx->budget_at;
+	if (elapsed >= budget_window_ns) {
+		__builtin_memset(cctx->class_ns, 0, sizeof(cctx->class_ns));
+		cctx->budget_at = now;
+		elapsed = 0;
+	}
+
+	if (!game_work_queued(cpu))
+		return false;
+
+	bpf_for(prio, PRIO_NORMAL, nr_levels) {
+		u64 dsq_id = prio_dsq(prio, cpu);
+		u64 served_at;
+
+		if (prio >= NR_PRIO_LEVELS || !scx_bpf_dsq_nr_queued(dsq_id))
+			continue;
+
+		served_at = queue_served_at[queue_slot(llc, prio)];
+		if (policy_queue_aged(served_at, starve_age_ns, now)) {
+			if (scx_bpf_consume(dsq_id)) {
+				mark_served(llc, prio);
+				STAT_INC(nr_dispatched[prio]);
+				STAT_INC(nr_aged_dispatched);
+				return true;
+			}
+			continue;
+		}
+
+		if (cpu_takes_level(cpu, prio) &&
+		    policy_budget_due(cctx->class_ns[prio], prio_share[prio],
+				      elapsed, served_at, slice_ns, now) &&
+		    scx_bpf_consume(dsq_id)) {
+			mark_served(llc, prio);
+			STAT_INC(nr_dispatched[prio]);
+			STAT_INC(nr_budget_dispatched);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Dispatch: consume this CPU's pinned DSQ, then DSQs in priority order.
+ * Isolated CPUs only consume game levels and go idle otherwise, those of
+ * a named partition only the game levels of their partition.
+ */
+void BPF_STRUCT_OPS(gamesched_dispatch, s32 cpu, struct task_struct *prev)
+{
+	u32 nr_levels;
+	u32 prio, part;
+
+	if (has_feature(GAMESCHED_FLAG_PINNING) &&
+	    scx_bpf_consume(DSQ_CPU_BASE + cpu)) {
+		STAT_INC(nr_pinned_dispatched);
+		return;
+	}
+
+	refresh_isolation();
+	nr_levels = policy_nr_levels(is_cpu_isolated(cpu));
+
+	if (sibling_quiet(cpu)) {
+		STAT_INC(nr_sibling_quiet);
+		return;
+	}
+
+	part = cpu_partition_of(cpu);
+	if (part) {
+		bpf_for(prio, 0, PRIO_NORMAL) {
+			if (scx_bpf_consume(part_dsq(part, prio))) {
+				if (prio < NR_PRIO_LEVELS)
+					STAT_INC(nr_dispatched[prio]);
+				PART_STAT_INC(part, nr_dispatched);
+				return;
+			}
+		}
+		return;
+	}
+
+	if (dispatch_starved(cpu, nr_levels))
+		return;
+
+	if (llc_shards) {
+		if (dispatch_llc(cpu, nr_levels))
+			return;
+	} else {
+		/* Consume from DSQs in priority order (0 = highest) */
+		bpf_for(prio, 0, nr_levels) {
+			if (!cpu_takes_level(cpu, prio))
+				continue;
+			if (scx_bpf_consume(DSQ_PRIO_BASE + prio)) {
+				mark_served(0, prio);
+				if (prio < NR_PRIO_LEVELS)
+					STAT_INC(nr_dispatched[prio]);
+				if (capacity_mismatch(cpu, prio))
+					STAT_INC(nr_capacity_fallbacks);
+				return;
+			}
+		}
+	}
+
+	if (nr_levels == NR_PRIO_LEVELS)
+		return;
+
+	/* Idling with normal work queued: that's isolation doing its job */
+	if (scx_bpf_dsq_nr_queued(prio_dsq(PRIO_NORMAL, cpu)) ||
+	    scx_bpf_dsq_nr_queued(prio_dsq(PRIO_BACKGROUND, cpu)))
+		STAT_INC(nr_isolated_blocked);
+}
+
+/*
+ * Get the latency histogram bucket of @ns: floor(log2(@ns)), capped.
+ */
+static u32 lat_bucket(u64 ns)
+{
+	u32 b = 0;
+
+	if (ns >= 1ULL << 32) {
+		ns >>= 32;
+		b += 32;
+	}
+	if (ns >= 1 << 16) {
+		ns >>= 16;
+		b += 16;
+	}
+	if (ns >= 1 << 8) {
+		ns >>= 8;
+		b += 8;
+	}
+	if (ns >= 1 << 4) {
+		ns >>= 4;
+		b += 4;
+	}
+	if (ns >= 1 << 2) {
+		ns >>= 2;
+		b += 2;
+	}
+	if (ns >= 1 << 1)
+		b += 1;
+
+	return b < NR_LAT_BUCKETS ? b : NR_LAT_BUCKETS - 1;
+}
+
+/*
+ * Record how long a task of priority @prio waited for a CPU.
+ */
+static void record_latency(u32 prio, u64 lat_ns)
+{
+	struct gamesched_lat_hist *hist;
+	u32 zero = 0;
+	u32 b;
+
+	hist = bpf_map_lookup_elem(&lat_hists, &zero);
+	if (!hist || prio >= NR_PRIO_LEVELS)
+		return;
+
+	b = lat_bucket(lat_ns);
+	if (b < NR_LAT_BUCKETS)
+		hist->buckets[prio][b]++;
+}
+
+/*
+ * Publish the detector state of a promoted task for status.
+ */
+static void publish_detected(struct task_struct *p, struct task_ctx *tctx,
+			     u64 now)
+{
+	struct gamesched_detected det = {
+		.tgid		= p->tgid,
+		.period_ns	= tctx->period_ewma,
+		.jitter_ns	= tctx->jitter_ewma,
+		.run_ns		= tctx->run_ewma,
+		.last_seen_ns	= now,
+	};
+	u32 pid = p->pid;
+
+	bpf_map_update_elem(&detected_threads, &pid, &det, BPF_ANY);
+}
+
+/*
+ * Drop a detector promotion once the task stopped looking frame-paced.
+ */
+static void expire_detection(struct task_struct *p, struct task_ctx *tctx,
+			     u64 now)
+{
+	u32 pid = p->pid;
+
+	if (!(tctx->flags & TASK_F_DETECTED) ||
+	    !vtime_before(tctx->detected_until, now))
+		return;
+
+	tctx->flags &= ~TASK_F_DETECTED;
+	set_task_prio(p, tctx, tctx->base_prio);
+	bpf_map_delete_elem(&detected_threads, &pid);
+}
+
+/*
+ * Render detection: track the wakeup cadence of a TGID member and promote
+ * it to render while it wakes up at a stable frame rate.
+ */
+static void detect_render(struct task_struct *p, struct task_ctx *tctx,
+			  u64 now)
+{
+	u64 interval = now - tctx->last_wakeup;
+	u64 dev;
+
+	if (!tctx->last_wakeup) {
+		tctx->last_wakeup = now;
+		return;
+	}
+	tctx->last_wakeup = now;
+
+	if (interval < detect_min_period_ns || interval > detect_max_period_ns) {
+		tctx->nr_periodic = 0;
+		goto check_expiry;
+	}
+
+	if (!tctx->period_ewma) {
+		tctx->period_ewma = interval;
+		tctx->jitter_ewma = 0;
+		goto check_expiry;
+	}
+
+	dev = interval > tctx->period_ewma ? interval - tctx->period_ewma :
+					     tctx->period_ewma - interval;
+	tctx->period_ewma = (tctx->period_ewma * 7 + interval) / 8;
+	tctx->jitter_ewma = (tctx->jitter_ewma * 3 + dev) / 4;
+
+	/* Frame-paced threads sleep between frames rather than spin */
+	if (tctx->jitter_ewma * 100 > tctx->period_ewma * detect_jitter_pct ||
+	    tctx->run_ewma >= tctx->period_ewma) {
+		tctx->nr_periodic = 0;
+		goto check_expiry;
+	}
+
+	if (++tctx->nr_periodic < DETECT_MIN_SAMPLES)
+		goto check_expiry;
+
+	tctx->detected_until = now + detect_timeout_ns;
+	if (!(tctx->flags & TASK_F_DETECTED)) {
+		tctx->flags |= TASK_F_DETECTED;
+		set_task_prio(p, tctx, PRIO_GAME_RENDER);
+	}
+	publish_detected(p, tctx, now);
+	return;
+
+check_expiry:
+	expire_detection(p, tctx, now);
+}
+
+/*
+ * A task became runnable: start its latency clock.
+ */
+void BPF_STRUCT_OPS(gamesched_runnable, struct task_struct *p, u64 enq_flags)
+{
+	struct task_ctx *tctx = lookup_task_ctx(p);
+	u64 now = bpf_ktime_get_ns();
+
+	if (!tctx)
+		return;
+
+	tctx->runnable_at = now;
+
+	if (render_detect && (tctx->flags & TASK_F_GROUP) &&
+	    (enq_flags & SCX_ENQ_WAKEUP))
+		detect_render(p, tctx, now);
+}
+
+/*
+ * Fold the busy time of @cctx's window into its utilization once the
+ * window is over.
+ */
+static void update_cpu_util(struct cpu_ctx *cctx, u64 now)
+{
+	u64 elapsed = now - cctx->util_at;
+	u64 busy;
+
+	if (elapsed < UTIL_WINDOW_NS)
+		return;
+
+	busy = cctx->util_busy * SCX_CPUPERF_ONE / elapsed;
+	if (busy > SCX_CPUPERF_ONE)
+		busy = SCX_CPUPERF_ONE;
+
+	cctx->util = (cctx->util + busy) / 2;
+	cctx->util_at = now;
+	cctx->util_busy = 0;
+}
+
+/*
+ * Request the perf target of a @prio task about to run on @cpu.
+ */
+static void update_cpuperf(s32 cpu, struct cpu_ctx *cctx, u32 prio)
+{
+	u32 perf, util;
+
+	if (!cpuperf_control || prio >= NR_PRIO_LEVELS ||
+	    cpu < 0 || cpu >= MAX_CPUS)
+		return;
+
+	perf = prio_perf[prio];
+	if (prio != PRIO_GAME_RENDER) {
+		/* Leave some headroom over the measured utilization */
+		util = cctx->util + cctx->util / 4;
+		if (util < perf)
+			perf = util;
+	}
+
+	if (cpu_perf_target[cpu] == perf)
+		return;
+
+	cpu_perf_target[cpu] = perf;
+	scx_bpf_cpuperf_set(cpu, perf);
+}
+
+/*
+ * Track the priority of the task each CPU is running, advance the vtime of
+ * its level, and record how long it waited.
+ */
+void BPF_STRUCT_OPS(gamesched_running, struct task_struct *p)
+{
+	struct cpu_ctx *cctx = lookup_cpu_ctx(-1);
+	struct task_ctx *tctx = lookup_task_ctx(p);
+	u32 prio = get_task_priority(tctx);
+	u64 now = bpf_ktime_get_ns();
+	u32 part;
+
+	if (cctx) {
+		cctx->cur_prio = prio;
+		if (cpuperf_control) {
+			update_cpu_util(cctx, now);
+			update_cpuperf(scx_bpf_task_cpu(p), cctx, prio);
+		}
+	}
+
+	/* Count what still interrupts game work on isolated CPUs */
+	if (prio >= PRIO_NORMAL && is_cpu_isolated(scx_bpf_task_cpu(p))) {
+		if (p->flags & PF_KTHREAD)
+			STAT_INC(nr_isolated_kthreads);
+		else
+			STAT_INC(nr_isolated_intrusions);
+	}
+
+	part = cpu_partition_of(scx_bpf_task_cpu(p));
+	if (part && task_partition(p, tctx) != part)
+		PART_STAT_INC(part, nr_intrusions);
+
+	/* Clear the core for a render task on an isolated CPU */
+	if (quiet_siblings && prio == PRIO_GAME_RENDER) {
+		s32 cpu = scx_bpf_task_cpu(p);
+		s32 sib = smt_sibling(cpu);
+
+		if (sib >= 0 && is_cpu_isolated(cpu))
+			scx_bpf_kick_cpu(sib, SCX_KICK_PREEMPT);
+	}
+
+	if (tctx) {
+		u64 wait_ns = 0;
+
+		tctx->started_at = now;
+		if (tctx->runnable_at) {
+			wait_ns = now - tctx->runnable_at;
+			record_latency(prio, wait_ns);
+			tctx->runnable_at = 0;
+		}
+		tctx->wait_ns = wait_ns;
+
+		/* Sample the run as a whole, stopping() follows this pick */
+		tctx->trace_run = trace_enabled && trace_sampled();
+		if (tctx->trace_run)
+			trace_emit(p, TRACE_RUNNING, prio, scx_bpf_task_cpu(p),
+				   TRACE_R_NONE, wait_ns);
+	}
+
+	if (vtime_enabled && prio < NR_PRIO_LEVELS &&
+	    vtime_before(vtime_now[prio], p->scx.dsq_vtime))
+		vtime_now[prio] = p->scx.dsq_vtime;
+}
+
+/*
+ * Adaptive mode: cut the remaining slice of a running normal or background
+ * task short once game work starts waiting, bounding game latency without
+ * preempting on every enqueue.
+ */
+void BPF_STRUCT_OPS(gamesched_tick, struct task_struct *p)
+{
+	struct task_ctx *tctx = lookup_task_ctx(p);
+
+	/* A boosted wakee that keeps running falls back to its own class */
+	if (tctx && tctx->boost_prio < NR_PRIO_LEVELS &&
+	    vtime_before(tctx->boosted_until, bpf_ktime_get_ns())) {
+		struct cpu_ctx *cctx = lookup_cpu_ctx(-1);
+
+		clear_boost(p, tctx);
+		if (cctx) {
+			cctx->cur_prio = get_task_priority(tctx);
+			update_cpuperf(scx_bpf_task_cpu(p), cctx,
+				       cctx->cur_prio);
+		}
+	}
+
+	if (!adaptive_slice)
+		return;
+
+	if (get_task_priority(tctx) < PRIO_NORMAL ||
+	    p->scx.slice <= slice_min_ns)
+		return;
+
+	if (game_work_queued(scx_bpf_task_cpu(p)))
+		p->scx.slice = slice_min_ns;
+}
+
+/*
+ * Account a run of @p that started at tctx->started_at on the task's
+ * thread_stats entry, creating it on the first run.
+ */
+static void update_thread_stats(struct task_struct *p, struct task_ctx *tctx,
+				u64 now)
+{
+	struct gamesched_thread_stats *ts;
+	s32 cpu = scx_bpf_task_cpu(p);
+	u32 pid = p->pid;
+
+	ts = bpf_map_lookup_elem(&thread_stats, &pid);
+	if (!ts) {
+		struct gamesched_thread_stats init = {
+			.tgid = p->tgid,
+			.last_cpu = cpu,
+		};
+
+		bpf_map_update_elem(&thread_stats, &pid, &init, BPF_NOEXIST);
+		ts = bpf_map_lookup_elem(&thread_stats, &pid);
+		if (!ts)
+			return;
+	}
+
+	if (ts->last_cpu != cpu)
+		ts->nr_migrations++;
+	ts->last_cpu = cpu;
+	ts->prio = get_task_priority(tctx);
+	ts->nr_runs++;
+	ts->runtime_ns += now - tctx->started_at;
+	ts->wait_ns += tctx->wait_ns;
+}
+
+/*
+ * Charge the task for the time it ran, scaled by the inverse of its weight.
+ * A task that stays runnable (preempted, slice expired) starts waiting again.
+ */
+void BPF_STRUCT_OPS(gamesched_stopping, struct task_struct *p, bool runnable)
+{
+	struct cpu_ctx *cctx = lookup_cpu_ctx(-1);
+	struct task_ctx *tctx = lookup_task_ctx(p);
+	u64 now = bpf_ktime_get_ns();
+
+	if (cctx) {
+		/* Let a quieted sibling pick its work back up */
+		if (quiet_siblings && cctx->cur_prio == PRIO_GAME_RENDER) {
+			s32 sib = smt_sibling(scx_bpf_task_cpu(p));
+
+			if (sib >= 0)
+				scx_bpf_kick_cpu(sib, SCX_KICK_IDLE);
+		}
+		cctx->cur_prio = NR_PRIO_LEVELS;
+	}
+
+	if (!tctx)
+		return;
+
+	if (runnable)
+		tctx->runnable_at = now;
+
+	/*
+	 * Run length per wakeup, for render detection. A promoted task that
+	 * keeps running without sleeping never wakes up again, so check the
+	 * promotion here too.
+	 */
+	if (render_detect && (tctx->flags & TASK_F_GROUP) && tctx->started_at) {
+		if (!runnable)
+			tctx->run_ewma = (tctx->run_ewma * 7 +
+					  (now - tctx->started_at)) / 8;
+		else
+			expire_detection(p, tctx, now);
+	}
+
+	if (tctx->started_at && thread_tracked(tctx))
+		update_thread_stats(p, tctx, now);
+
+	if (tctx->started_at) {
+		u32 part = cpu_partition_of(scx_bpf_task_cpu(p));
+
+		STAT_ADD(busy_ns, now - tctx->started_at);
+		if (part)
+			PART_STAT_ADD(part, busy_ns, now - tctx->started_at);
+		if (cctx) {
+			u32 prio = get_task_priority(tctx);
+
+			cctx->util_busy += now - tctx->started_at;
+			if (prio < NR_PRIO_LEVELS)
+				cctx->class_ns[prio] += now - tctx->started_at;
+		}
+	}
+
+	if (vtime_enabled && tctx->started_at && p->scx.weight)
+		p->scx.dsq_vtime += (now - tctx->started_at) * 100 /
+				    p->scx.weight;
+
+	if (tctx->started_at && tctx->trace_run)
+		trace_emit(p, TRACE_STOPPING, get_task_priority(tctx),
+			   scx_bpf_task_cpu(p),
+			   runnable ? TRACE_R_RUNNABLE : TRACE_R_NONE,
+			   now - tctx->started_at);
+
+	/* A wakee boost lasts for one run */
+	clear_boost(p, tctx);
+}
+
+/*
+ * Allocate and fill the per-task context.
+ */
+s32 BPF_STRUCT_OPS(gamesched_init_task, struct task_struct *p,
+		   struct scx_init_task_args *args)
+{
+	struct bpf_cpumask *mask;
+	struct task_ctx *tctx;
+
+	tctx = bpf_task_storage_get(&task_ctxs, p, 0,
+				    BPF_LOCAL_STORAGE_GET_F_CREATE);
+	if (!tctx)
+		return -ENOMEM;
+
+	mask = bpf_cpumask_create();
+	if (!mask)
+		return -ENOMEM;
+
+	mask = bpf_kptr_xchg(&tctx->tmp_mask, mask);
+	if (mask)
+		bpf_cpumask_release(mask);
+
+	tctx->boost_prio = NR_PRIO_LEVELS;
+	refresh_task_ctx(p, tctx, read_gen(GEN_REGISTRY), args->cgroup);
+	if (tctx->prio < NR_PRIO_LEVELS)
+		p->scx.dsq_vtime = vtime_now[tctx->prio];
+	return 0;
+}
+
+/*
+ * Drop the registrations of an exiting task so the maps don't fill up with
+ * dead PIDs over a session. exit_task also runs for every live task when
+ * the scheduler is unloaded; those registrations are kept.
+ */
+void BPF_STRUCT_OPS(gamesched_exit_task, struct task_struct *p,
+		    struct scx_exit_task_args *args)
+{
+	u32 pid = p->pid, tgid = p->tgid;
+
+	if (!(p->flags & PF_EXITING))
+		return;
+
+	bpf_map_delete_elem(&game_threads, &pid);
+	bpf_map_delete_elem(&pinned_threads, &pid);
+	bpf_map_delete_elem(&detected_threads, &pid);
+	bpf_map_delete_elem(&thread_stats, &pid);
+
+	/*
+	 * Keep the process registered while any of its threads lives: the
+	 * leader may exit first, and threads created later still have to
+	 * match. signal->live counts the threads that haven't exited yet.
+	 */
+	if (!p->signal->live.counter)
+		bpf_map_delete_elem(&game_tgids, &tgid);
+}
+
+/*
+ * Build the per-LLC cpumasks from the topology provided by userspace.
+ */
+static s32 init_llc_masks(void)
+{
+	u32 nr_cpus = scx_bpf_nr_cpu_ids();
+	struct bpf_cpumask *mask;
+	struct llc_ctx *lctx;
+	u32 llc, cpu;
+
+	bpf_for(llc, 0, nr_llcs) {
+		lctx = bpf_map_lookup_elem(&llc_masks, &llc);
+		if (!lctx)
+			return -EINVAL;
+
+		mask = bpf_cpumask_create();
+		if (!mask)
+			return -ENOMEM;
+
+		bpf_for(cpu, 0, nr_cpus) {
+			if (cpu < MAX_CPUS && cpu_llc_id[cpu] == llc)
+				bpf_cpumask_set_cpu(cpu, mask);
+		}
+
+		mask = bpf_kptr_xchg(&lctx->cpumask, mask);
+		if (mask)
+			bpf_cpumask_release(mask);
+	}
+
+	return 0;
+}
+
+/*
+ * Build the placement domain cpumasks from the map provided by userspace.
+ */
+static s32 init_domain_masks(void)
+{
+	u32 nr_cpus = scx_bpf_nr_cpu_ids();
+	struct bpf_cpumask *game, *system;
+	u32 cpu;
+
+	game = bpf_cpumask_create();
+	if (!game)
+		return -ENOMEM;
+	system = bpf_cpumask_create();
+	if (!system) {
+		bpf_cpumask_release(game);
+		return -ENOMEM;
+	}
+
+	bpf_for(cpu, 0, nr_cpus) {
+		if (cpu < MAX_CPUS && cpu_domain[cpu] == DOM_GAME)
+			bpf_cpumask_set_cpu(cpu, game);
+		else
+			bpf_cpumask_set_cpu(cpu, system);
+	}
+
+	game = bpf_kptr_xchg(&game_domain_mask, game);
+	if (game)
+		bpf_cpumask_release(game);
+	system = bpf_kptr_xchg(&system_domain_mask, system);
+	if (system)
+		bpf_cpumask_release(system);
+
+	return 0;
+}
+
+/*
+ * Hybrid steering: split the CPUs by capacity into the highest-capacity
+ * ones and the rest.
+ */
+static s32 init_capacity_masks(void)
+{
+	u32 nr_cpus = scx_bpf_nr_cpu_ids();
+	struct bpf_cpumask *big, *little;
+	struct cpu_ctx *cctx;
+	u32 cpu, cap, max_cap = 0;
+
+	big = bpf_cpumask_create();
+	if (!big)
+		return -ENOMEM;
+	little = bpf_cpumask_create();
+	if (!little) {
+		bpf_cpumask_release(big);
+		return -ENOMEM;
+	}
+
+	bpf_for(cpu, 0, nr_cpus) {
+		cap = scx_bpf_cpuperf_cap(cpu);
+		if (cap > max_cap)
+			max_cap = cap;
+	}
+
+	bpf_for(cpu, 0, nr_cpus) {
+		bool is_big = scx_bpf_cpuperf_cap(cpu) == max_cap;
+
+		if (is_big) {
+			bpf_cpumask_set_cpu(cpu, big);
+			nr_big_cpus++;
+		} else {
+			bpf_cpumask_set_cpu(cpu, little);
+			nr_little_cpus++;
+		}
+
+		cctx = lookup_cpu_ctx(cpu);
+		if (cctx)
+			cctx->big = is_big;
+	}
+
+	big = bpf_kptr_xchg(&big_mask, big);
+	if (big)
+		bpf_cpumask_release(big);
+	little = bpf_kptr_xchg(&little_mask, little);
+	if (little)
+		bpf_cpumask_release(little);
+
+	return 0;
+}
+
+/*
+ * Re-classify a task moving between cgroups, e.g. a game launched from a
+ * shell and moved into its systemd scope.
+ */
+void BPF_STRUCT_OPS(gamesched_cgroup_move, struct task_struct *p,
+		    struct cgroup *from, struct cgroup *to)
+{
+	struct task_ctx *tctx;
+
+	tctx = bpf_task_storage_get(&task_ctxs, p, 0, 0);
+	if (tctx)
+		refresh_task_ctx(p, tctx, read_gen(GEN_REGISTRY), to);
+}
+
+/*
+ * Threads usually get their real name after they've been created, so
+ * re-classify group members when they're renamed. The new comm is only
+ * copied after this tracepoint fires, so just invalidate the cached state.
+ */
+SEC("tp_btf/task_rename")
+int BPF_PROG(gamesched_task_rename, struct task_struct *p, const char *comm)
+{
+	struct task_ctx *tctx;
+
+	tctx = bpf_task_storage_get(&task_ctxs, p, 0, 0);
+	if (tctx && (tctx->flags & TASK_F_GROUP))
+		tctx->gen = ~0ULL;
+
+	return 0;
+}
+
+/*
+ * Initialize the scheduler.
+ */
+s32 BPF_STRUCT_OPS_SLEEPABLE(gamesched_init)
+{
+	u32 nr_cpus = scx_bpf_nr_cpu_ids();
+	s32 ret;
+	u32 i, llc, part;
+
+	/* Create the per-CPU DSQs for pinned threads */
+	bpf_for(i, 0, has_feature(GAMESCHED_FLAG_PINNING) ? nr_cpus : 0) {
+		ret = scx_bpf_create_dsq(DSQ_CPU_BASE + i, -1);
+		if (ret)
+			return ret;
+	}
+
+	/* Create DSQs for each priority level */
+	bpf_for(i, 0, NR_PRIO_LEVELS) {
+		ret = scx_bpf_create_dsq(DSQ_PRIO_BASE + i, -1);
+		if (ret)
+			return ret;
+	}
+
+	/* And one set per named isolation partition */
+	bpf_for(part, has_feature(GAMESCHED_FLAG_ISOLATION) ? 1 : MAX_PARTITIONS,
+		MAX_PARTITIONS) {
+		bpf_for(i, 0, NR_PRIO_LEVELS) {
+			ret = scx_bpf_create_dsq(part_dsq(part, i), -1);
+			if (ret)
+				return ret;
+		}
+	}
+
+	/* And one set per LLC in sharded mode */
+	if (llc_shards) {
+		bpf_for(llc, 0, nr_llcs) {
+			bpf_for(i, 0, NR_PRIO_LEVELS) {
+				ret = scx_bpf_create_dsq(llc_dsq(llc, i), -1);
+				if (ret)
+					return ret;
+			}
+		}
+	}
+
+	ret = init_llc_masks();
+	if (ret)
+		return ret;
+
+	ret = init_domain_masks();
+	if (ret)
+		return ret;
+
+	ret = init_capacity_masks();
+	if (ret)
+		return ret;
+
+	refresh_isolation();
+	if (!isolated_mask || !nonisolated_mask || !unpartitioned_mask)
+		return -ENOMEM;
+
 	return 0;
 }
 
@@ -255,6 +2762,14 @@ SCX_OPS_DEFINE(gamesched_ops,
 	       .select_cpu		= (void *)gamesched_select_cpu,
 	       .enqueue			= (void *)gamesched_enqueue,
 	       .dispatch		= (void *)gamesched_dispatch,
+	       .tick			= (void *)gamesched_tick,
+	       .runnable		= (void *)gamesched_runnable,
+	       .running			= (void *)gamesched_running,
+	       .stopping		= (void *)gamesched_stopping,
+	       .init_task		= (void *)gamesched_init_task,
+	       .exit_task		= (void *)gamesched_exit_task,
+	       .cgroup_move		= (void *)gamesched_cgroup_move,
 	       .init			= (void *)gamesched_init,
 	       .exit			= (void *)gamesched_exit,
+	       .flags			= SCX_OPS_ENQ_LAST,
 	       .name			= "gamesched");
@@ -5,9 +5,12 @@
  * Commands:
  *   scx_gamesched                    - Run scheduler with defaults
  *   scx_gamesched add --pid PID --priority render|game
+ *   scx_gamesched add --cgroup PATH --priority render|game
  *   scx_gamesched remove --pid PID
  *   scx_gamesched isolate --cpus 2,3
+ *   scx_gamesched partition add --name NAME --cpus 4-7 --tgid TGID
  *   scx_gamesched pin --pid PID --cpu N
+ *   scx_gamesched apply --file FILE|-
  *   scx_gamesched status
  *
  * BPF maps are pinned to /sys/fs/bpf/gamesched/ so CLI commands can
@@ -15,6 +18,7 @@
  *
  * Copyright (c) 2026 GameSched Project
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,17 +26,38 @@
 #include <signal.h>
 #include <libgen.h>
 #include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
 #include <bpf/bpf.h>
 #include <scx/common.h>
 #include "scx_gamesched.h"
 #include "scx_gamesched.bpf.skel.h"
 
+/* cgroup v2 mount point, relative cgroup paths are resolved against it */
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
 /* BPF map pinning paths */
 #define PIN_PATH "/sys/fs/bpf/gamesched"
 #define PIN_GAME_THREADS PIN_PATH "/game_threads"
 #define PIN_ISOLATED_CPUS PIN_PATH "/isolated_cpus"
 #define PIN_PINNED_THREADS PIN_PATH "/pinned_threads"
+#define PIN_GENERATION PIN_PATH "/generation"
+#define PIN_GAME_TGIDS PIN_PATH "/game_tgids"
+#define PIN_GAME_CGROUPS PIN_PATH "/game_cgroups"
+#define PIN_COMM_RULES PIN_PATH "/comm_rules"
+#define PIN_DETECTED_THREADS PIN_PATH "/detected_threads"
+#define PIN_PARTITIONS PIN_PATH "/partitions"
+#define PIN_PARTITION_STATS PIN_PATH "/partition_stats"
+#define PIN_THREAD_STATS PIN_PATH "/thread_stats"
+#define PIN_SCHED_INFO PIN_PATH "/sched_info"
 
 static const char help_fmt[] =
 "scx_gamesched - A gaming-optimized sched_ext scheduler\n"
@@ -42,18 +67,92 @@ static const char help_fmt[] =
 "Commands:\n"
 "  (none)                      Run the scheduler\n"
 "  add --pid PID --priority PRIO   Add game thread (PRIO: render, game)\n"
+"  add --tgid TGID --priority PRIO [--comm PATTERN=PRIO,...]\n"
+"                              Add all threads of a process, optionally\n"
+"                              classifying them by thread-name prefix\n"
+"  add --cgroup PATH --priority PRIO [--isolate CPU_LIST]\n"
+"                              Add all tasks of a cgroup (e.g. a systemd\n"
+"                              scope), optionally isolating CPUs for it\n"
 "  remove --pid PID            Remove game thread\n"
+"  remove --tgid TGID          Remove game process\n"
+"  remove --cgroup PATH        Remove game cgroup\n"
+"  remove --comm PATTERN       Remove thread-name rule\n"
 "  isolate --cpus CPU_LIST     Isolate CPUs (e.g., 2,3)\n"
-"  isolate --clear             Clear CPU isolation\n"
+"  isolate --cores CPU_LIST    Isolate CPUs with their SMT siblings\n"
+"  isolate --llc CPU_LIST      Isolate every CPU sharing the LLC of CPUs\n"
+"  isolate --clear             Clear CPU isolation (partitions stay)\n"
+"  partition add --name NAME --cpus CPU_LIST --tgid TGID|--cgroup PATH\n"
+"                              Isolate CPUs for one game only, which in\n"
+"                              turn only uses them\n"
+"  partition remove --name NAME  Release a partition's CPUs\n"
 "  pin --pid PID --cpu CPU     Pin thread to CPU\n"
+"  apply --file FILE|-         Apply a set of registrations, pins and\n"
+"                              isolation in one go (see README)\n"
 "  status                      Show current configuration\n"
 "\n"
 "Options:\n"
+"  -l            Shard priority queues per LLC (steal across LLCs when idle)\n"
+"  -p PRIO_LIST  Priorities that preempt lower ones on wakeup\n"
+"                (render,game,normal or none; default: render,game)\n"
+"  -w            Order tasks within each priority by weighted vtime\n"
+"  -s SLICES     Per-priority time slices in us\n"
+"                (e.g. render=20000,normal=5000,background=100000)\n"
+"  -a MIN_US     Adaptive slices: cut normal/background slices to MIN_US\n"
+"                while game work is waiting\n"
+"  -g SHARES     Share of each CPU guaranteed to a class per 100ms, in\n"
+"                percent (e.g. normal=10, default: none). Served ahead of\n"
+"                waiting game work while behind\n"
+"  -A AGE_MS     Serve a queue that made no progress for AGE_MS ahead of\n"
+"                waiting game work (default: 250, 0 disables)\n"
+"  -r            Detect render threads of registered processes from their\n"
+"                frame-paced wakeups and promote them to render\n"
+"  -b            Boost tasks woken by game threads to the waker's class\n"
+"                for one run\n"
+"  -n MAX        Capacity of the thread/process registration maps\n"
+"                (default: 1024)\n"
+"  -q            Keep the SMT sibling of an isolated CPU idle while a\n"
+"                render thread runs on it\n"
+"  -k            Strict isolation: only kernel threads bound to an isolated\n"
+"                CPU may run there, other kthreads are steered off it\n"
+"  -I            Move IRQs and unbound workqueues off isolated CPUs while\n"
+"                they are isolated, restoring them on exit\n"
+"  -d auto|CPUS  Game placement domain: CPUs with the largest LLC (auto,\n"
+"                e.g. the V-cache CCD) or an explicit list. Game tasks\n"
+"                prefer idle CPUs there, other tasks the remaining CPUs\n"
+"  -f PERFS      Drive CPU frequency per class, targets in percent of max\n"
+"                from 1 to 100 (e.g. render=100,game=90,background=40).\n"
+"                Render runs at its target, other classes at utilization\n"
+"                up to theirs\n"
+"  -H            Hybrid CPUs: keep game tasks on the highest-capacity\n"
+"                cores and background tasks on the others until saturated\n"
+"  -t FILE       Write a binary scheduling trace to FILE\n"
+"  -T PRIOS      Classes to trace (default: all, e.g. render)\n"
+"  -R N          Trace one in N events (default: 1)\n"
+"  -D FEATURES   Leave features out of the scheduler: isolation, pinning\n"
+"                (e.g. -D isolation,pinning). Their commands have no effect\n"
+"  -u            Reload: take over from the running instance, keeping its\n"
+"                registrations, pins and isolation\n"
+"  -c            Show per-CPU statistics\n"
 "  -v            Verbose output\n"
 "  -h            Display this help\n";
 
+static const char *prio_names[NR_PRIO_LEVELS] = {
+	[PRIO_GAME_RENDER]	= "render",
+	[PRIO_GAME_OTHER]	= "game",
+	[PRIO_NORMAL]		= "normal",
+	[PRIO_BACKGROUND]	= "background",
+};
+
 static volatile int exit_req;
 static bool verbose;
+static bool percpu_stats;
+static const char *trace_path;
+static bool reload;
+static bool steer_irqs;
+
+/* Set once the scheduler handed its maps to a reloading instance */
+static struct bpf_link *ops_link;
+static bool handed_off;
 
 static void sigint_handler(int sig)
 {
@@ -69,255 +168,3213 @@ static int libbpf_print_fn(enum libbpf_print_level level,
 }
 
 /*
- * Parse a comma-separated list of CPU IDs.
+ * Parse a comma-separated list of CPU IDs.
+ */
+static int parse_cpu_list(const char *str, int *cpus, int max_cpus)
+{
+	char *copy, *token, *saveptr;
+	int count = 0;
+
+	copy = strdup(str);
+	if (!copy)
+		return -1;
+
+	token = strtok_r(copy, ",\n", &saveptr);
+	while (token && count < max_cpus) {
+		char *dash = strchr(token, '-');
+		int first = atoi(token);
+		int last = dash ? atoi(dash + 1) : first;
+
+		for (int cpu = first; cpu <= last && count < max_cpus; cpu++)
+			cpus[count++] = cpu;
+		token = strtok_r(NULL, ",\n", &saveptr);
+	}
+
+	free(copy);
+	return count;
+}
+
+/*
+ * File descriptors of the pinned BPF maps used by CLI commands.
+ */
+struct gamesched_maps {
+	int game_threads;
+	int isolated_cpus;
+	int pinned_threads;
+	int generation;
+	int game_tgids;
+	int game_cgroups;
+	int comm_rules;
+	int detected_threads;
+	int partitions;
+	int partition_stats;
+	int thread_stats;
+	u32 sched_flags;	/* of the running instance */
+};
+
+/*
+ * Parse a priority name. Returns -1 if unknown.
+ */
+static int parse_priority(const char *str)
+{
+	if (strcmp(str, "render") == 0)
+		return PRIO_GAME_RENDER;
+	if (strcmp(str, "game") == 0)
+		return PRIO_GAME_OTHER;
+	if (strcmp(str, "normal") == 0)
+		return PRIO_NORMAL;
+	if (strcmp(str, "background") == 0)
+		return PRIO_BACKGROUND;
+	return -1;
+}
+
+/*
+ * Parse a comma-separated list of priority names into a bitmask.
+ * Returns -1 on error.
+ */
+static int parse_priority_mask(const char *str)
+{
+	char *copy, *token, *saveptr;
+	int mask = 0;
+
+	if (strcmp(str, "none") == 0)
+		return 0;
+
+	copy = strdup(str);
+	if (!copy)
+		return -1;
+
+	for (token = strtok_r(copy, ",", &saveptr); token;
+	     token = strtok_r(NULL, ",", &saveptr)) {
+		int prio = parse_priority(token);
+
+		if (prio < 0) {
+			fprintf(stderr, "Invalid priority: %s\n", token);
+			mask = -1;
+			break;
+		}
+		mask |= 1 << prio;
+	}
+
+	free(copy);
+	return mask;
+}
+
+/*
+ * Parse a comma-separated list of features to leave out of the load into
+ * GAMESCHED_FLAG_* bits. Returns -1 on error.
+ */
+static int parse_features(const char *str)
+{
+	char *copy, *token, *saveptr;
+	int flags = 0;
+
+	copy = strdup(str);
+	if (!copy)
+		return -1;
+
+	for (token = strtok_r(copy, ",", &saveptr); token;
+	     token = strtok_r(NULL, ",", &saveptr)) {
+		if (strcmp(token, "isolation") == 0) {
+			flags |= GAMESCHED_FLAG_ISOLATION;
+		} else if (strcmp(token, "pinning") == 0) {
+			flags |= GAMESCHED_FLAG_PINNING;
+		} else {
+			fprintf(stderr, "Invalid feature: %s\n", token);
+			flags = -1;
+			break;
+		}
+	}
+
+	free(copy);
+	return flags;
+}
+
+/*
+ * Parse a comma-separated list of PRIO=VALUE pairs into @vals, leaving
+ * priorities that aren't mentioned untouched. Returns -1 on error.
+ */
+static int parse_priority_values(const char *str, long *vals)
+{
+	char *copy, *token, *saveptr;
+	int ret = 0;
+
+	copy = strdup(str);
+	if (!copy)
+		return -1;
+
+	for (token = strtok_r(copy, ",", &saveptr); token;
+	     token = strtok_r(NULL, ",", &saveptr)) {
+		char *eq = strchr(token, '=');
+		int prio;
+
+		if (!eq) {
+			fprintf(stderr, "Expected PRIO=VALUE, got: %s\n", token);
+			ret = -1;
+			break;
+		}
+		*eq = '\0';
+
+		prio = parse_priority(token);
+		if (prio < 0) {
+			fprintf(stderr, "Invalid priority: %s\n", token);
+			ret = -1;
+			break;
+		}
+		vals[prio] = atol(eq + 1);
+	}
+
+	free(copy);
+	return ret;
+}
+
+/*
+ * Read a single integer from a sysfs file. Returns -1 on failure.
+ */
+static long read_sysfs_long(const char *path)
+{
+	FILE *f;
+	long val;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	if (fscanf(f, "%ld", &val) != 1)
+		val = -1;
+
+	fclose(f);
+	return val;
+}
+
+/*
+ * Find the sysfs cache index of the last-level cache of a CPU, or -1.
+ */
+static int cpu_llc_index(int cpu)
+{
+	char path[128];
+	long level, best_level = -1;
+	int idx, best = -1;
+
+	for (idx = 0; idx < 8; idx++) {
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cache/index%d/level",
+			 cpu, idx);
+		level = read_sysfs_long(path);
+		if (level < 0)
+			break;
+		if (level > best_level) {
+			best_level = level;
+			best = idx;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * Find the id of the last-level cache of a CPU, or -1 if unknown.
+ */
+static long read_cpu_llc(int cpu)
+{
+	char path[128];
+	int idx = cpu_llc_index(cpu);
+
+	if (idx < 0)
+		return -1;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/cache/index%d/id", cpu, idx);
+	return read_sysfs_long(path);
+}
+
+/*
+ * Read a sysfs CPU list file (e.g. "0,8" or "0-7") into @cpus.
+ * Returns the number of CPUs, or -1 on failure.
+ */
+static int read_sysfs_cpus(const char *path, int *cpus, int max_cpus)
+{
+	char buf[256];
+	FILE *f;
+	int ret = -1;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	if (fgets(buf, sizeof(buf), f))
+		ret = parse_cpu_list(buf, cpus, max_cpus);
+
+	fclose(f);
+	return ret;
+}
+
+/*
+ * Read the SMT siblings of a CPU, including itself.
+ */
+static int read_cpu_siblings(int cpu, int *cpus, int max_cpus)
+{
+	char path[128];
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+	return read_sysfs_cpus(path, cpus, max_cpus);
+}
+
+/*
+ * Read the CPUs sharing a CPU's last-level cache, including itself.
+ */
+static int read_cpu_llc_cpus(int cpu, int *cpus, int max_cpus)
+{
+	char path[128];
+	int idx = cpu_llc_index(cpu);
+
+	if (idx < 0)
+		return -1;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+		 cpu, idx);
+	return read_sysfs_cpus(path, cpus, max_cpus);
+}
+
+/*
+ * Fill the topology rodata (LLC of each CPU) before the BPF program loads.
+ * CPUs with unknown topology all share LLC 0.
+ */
+static void init_topology(struct scx_gamesched *skel)
+{
+	long llc_ids[MAX_LLCS];
+	int nr_cpus = libbpf_num_possible_cpus();
+	int nr_llcs = 0;
+	int cpu, i;
+
+	if (nr_cpus > MAX_CPUS)
+		nr_cpus = MAX_CPUS;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		long id = read_cpu_llc(cpu);
+
+		for (i = 0; i < nr_llcs; i++)
+			if (llc_ids[i] == id)
+				break;
+
+		if (i == nr_llcs) {
+			if (nr_llcs < MAX_LLCS)
+				llc_ids[nr_llcs++] = id;
+			else
+				i = 0;	/* fold overflow domains into LLC 0 */
+		}
+
+		skel->rodata->cpu_llc_id[cpu] = i;
+	}
+
+	for (cpu = 0; cpu < MAX_CPUS; cpu++)
+		skel->rodata->cpu_sibling[cpu] = -1;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		int sibs[8], nr_sibs;
+
+		nr_sibs = read_cpu_siblings(cpu, sibs, 8);
+		for (i = 0; i < nr_sibs; i++) {
+			if (sibs[i] != cpu && sibs[i] < MAX_CPUS) {
+				skel->rodata->cpu_sibling[cpu] = sibs[i];
+				break;
+			}
+		}
+	}
+
+	skel->rodata->nr_llcs = nr_llcs ? nr_llcs : 1;
+
+	if (verbose)
+		printf("Detected %d CPUs in %d LLC domain(s)\n", nr_cpus,
+		       skel->rodata->nr_llcs);
+}
+
+/*
+ * Read the size in bytes of a CPU's last-level cache, or -1 if unknown.
+ */
+static long read_cpu_llc_size(int cpu)
+{
+	char path[128], unit = 0;
+	int idx = cpu_llc_index(cpu);
+	long size = -1;
+	FILE *f;
+
+	if (idx < 0)
+		return -1;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/cache/index%d/size", cpu, idx);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%ld%c", &size, &unit) < 1)
+		size = -1;
+	fclose(f);
+
+	if (unit == 'K')
+		size <<= 10;
+	else if (unit == 'M')
+		size <<= 20;
+	return size;
+}
+
+/*
+ * Set up the game/system placement domains. @spec is "auto" to put the
+ * CPUs with the largest last-level cache (the V-cache CCD of X3D parts)
+ * in the game domain, or an explicit list of game-domain CPUs.
+ */
+static int init_domains(struct scx_gamesched *skel, const char *spec)
+{
+	int nr_cpus = libbpf_num_possible_cpus();
+	long sizes[MAX_CPUS], max_size = -1, min_size = -1;
+	int cpus[MAX_CPUS];
+	int cpu, count, nr_game = 0;
+
+	if (nr_cpus > MAX_CPUS)
+		nr_cpus = MAX_CPUS;
+
+	for (cpu = 0; cpu < MAX_CPUS; cpu++)
+		skel->rodata->cpu_domain[cpu] = DOM_SYSTEM;
+
+	if (strcmp(spec, "auto") == 0) {
+		for (cpu = 0; cpu < nr_cpus; cpu++) {
+			sizes[cpu] = read_cpu_llc_size(cpu);
+			if (sizes[cpu] < 0)
+				continue;
+			if (sizes[cpu] > max_size)
+				max_size = sizes[cpu];
+			if (min_size < 0 || sizes[cpu] < min_size)
+				min_size = sizes[cpu];
+		}
+
+		if (max_size <= 0 || max_size == min_size) {
+			fprintf(stderr, "Warning: all LLCs are the same size, "
+				"placement domains disabled\n");
+			return 0;
+		}
+
+		for (cpu = 0; cpu < nr_cpus; cpu++) {
+			if (sizes[cpu] == max_size) {
+				skel->rodata->cpu_domain[cpu] = DOM_GAME;
+				nr_game++;
+			}
+		}
+	} else {
+		count = parse_cpu_list(spec, cpus, MAX_CPUS);
+		for (int i = 0; i < count; i++) {
+			if (cpus[i] < 0 || cpus[i] >= nr_cpus) {
+				fprintf(stderr, "Invalid game domain CPU %d\n", cpus[i]);
+				return -1;
+			}
+			if (skel->rodata->cpu_domain[cpus[i]] != DOM_GAME)
+				nr_game++;
+			skel->rodata->cpu_domain[cpus[i]] = DOM_GAME;
+		}
+	}
+
+	if (!nr_game || nr_game == nr_cpus) {
+		fprintf(stderr, "Warning: game domain %s, placement domains disabled\n",
+			nr_game ? "spans all CPUs" : "is empty");
+		return 0;
+	}
+
+	skel->rodata->domains_enabled = true;
+	if (verbose)
+		printf("Game domain: %d CPUs, system domain: %d CPUs\n",
+		       nr_game, nr_cpus - nr_game);
+	return 0;
+}
+
+/*
+ * Take the writer lock of the pinned maps: an exclusive flock on
+ * PIN_PATH. CLI commands, apply, the control socket server and a reload
+ * all publish generation bumps and the inactive isolation copy, so only
+ * one of them may do so at a time. It is held only around publishing,
+ * never while waiting for user input or output. With @wait false, fail
+ * with EWOULDBLOCK instead of waiting for another writer.
+ * Returns the fd holding the lock, to be closed to drop it, or -1.
+ */
+static int lock_maps(bool wait)
+{
+	int fd = open(PIN_PATH, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+
+	while (flock(fd, wait ? LOCK_EX : LOCK_EX | LOCK_NB) < 0) {
+		if (errno != EINTR) {
+			int err = errno;
+
+			close(fd);
+			errno = err;
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+/*
+ * Open pinned BPF maps for CLI commands.
+ * Returns 0 on success, -1 if scheduler is not running.
+ */
+static int open_pinned_maps(struct gamesched_maps *maps)
+{
+	int fd;
+
+	maps->game_threads = bpf_obj_get(PIN_GAME_THREADS);
+	if (maps->game_threads < 0) {
+		fprintf(stderr, "Error: GameSched scheduler is not running.\n");
+		fprintf(stderr, "Start it first with: sudo scx_gamesched\n");
+		return -1;
+	}
+
+	maps->isolated_cpus = bpf_obj_get(PIN_ISOLATED_CPUS);
+	maps->pinned_threads = bpf_obj_get(PIN_PINNED_THREADS);
+	maps->generation = bpf_obj_get(PIN_GENERATION);
+	maps->game_tgids = bpf_obj_get(PIN_GAME_TGIDS);
+	maps->game_cgroups = bpf_obj_get(PIN_GAME_CGROUPS);
+	maps->comm_rules = bpf_obj_get(PIN_COMM_RULES);
+	maps->detected_threads = bpf_obj_get(PIN_DETECTED_THREADS);
+	maps->partitions = bpf_obj_get(PIN_PARTITIONS);
+	maps->partition_stats = bpf_obj_get(PIN_PARTITION_STATS);
+	maps->thread_stats = bpf_obj_get(PIN_THREAD_STATS);
+
+	/* An older instance without sched_info has every feature */
+	maps->sched_flags = GAMESCHED_FLAGS_ALL;
+	fd = bpf_obj_get(PIN_SCHED_INFO);
+	if (fd >= 0) {
+		u32 key = INFO_SCHED_FLAGS;
+
+		bpf_map_lookup_elem(fd, &key, &maps->sched_flags);
+		close(fd);
+	}
+
+	return 0;
+}
+
+/*
+ * Check if the running scheduler was loaded with feature @flag.
+ */
+static bool have_feature(const struct gamesched_maps *maps, u32 flag)
+{
+	return !(maps->sched_flags & GAMESCHED_FLAG_ENABLED) ||
+	       (maps->sched_flags & flag);
+}
+
+/*
+ * Fail a command that needs feature @flag on a scheduler loaded without
+ * it, instead of reporting success for a map nothing reads.
+ */
+static int need_feature(const struct gamesched_maps *maps, u32 flag)
+{
+	if (have_feature(maps, flag))
+		return 0;
+
+	fprintf(stderr, "Error: the running scheduler was started with -D %s\n",
+		flag == GAMESCHED_FLAG_ISOLATION ? "isolation" : "pinning");
+	return -1;
+}
+
+/*
+ * Describe a failed registration map update, pointing at -n when the map
+ * is full.
+ */
+static const char *update_error(int err)
+{
+	if (err == E2BIG)
+		return "map full (reload the scheduler with -u and a larger -n)";
+	return strerror(err);
+}
+
+/*
+ * Bump a generation counter so BPF refreshes the state cached from the
+ * maps it covers, with the writer lock held (lock_maps()).
+ */
+static int bump_generation_locked(struct gamesched_maps *maps, u32 idx)
+{
+	u64 gen = 0;
+
+	bpf_map_lookup_elem(maps->generation, &idx, &gen);
+	gen++;
+
+	if (bpf_map_update_elem(maps->generation, &idx, &gen, BPF_ANY) < 0) {
+		fprintf(stderr, "Failed to bump generation %u: %s\n",
+			idx, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Bump a generation counter from a CLI command, after the maps it covers
+ * have been updated.
+ */
+static int bump_generation(struct gamesched_maps *maps, u32 idx)
+{
+	int lock, ret;
+
+	lock = lock_maps(true);
+	if (lock < 0) {
+		fprintf(stderr, "Failed to lock %s: %s\n", PIN_PATH, strerror(errno));
+		return -1;
+	}
+
+	ret = bump_generation_locked(maps, idx);
+	close(lock);
+	return ret;
+}
+
+/*
+ * Maps pinned for the CLI and carried over by a reload, in the order of
+ * skel_pinned_maps().
+ */
+#define NR_PINNED_MAPS	11
+
+static const char *const pin_paths[NR_PINNED_MAPS] = {
+	PIN_GAME_THREADS, PIN_ISOLATED_CPUS, PIN_PINNED_THREADS,
+	PIN_GENERATION, PIN_GAME_TGIDS, PIN_GAME_CGROUPS, PIN_COMM_RULES,
+	PIN_DETECTED_THREADS, PIN_PARTITIONS, PIN_PARTITION_STATS,
+	PIN_THREAD_STATS,
+};
+
+static void skel_pinned_maps(struct scx_gamesched *skel, struct bpf_map **maps)
+{
+	maps[0] = skel->maps.game_threads;
+	maps[1] = skel->maps.isolated_cpus;
+	maps[2] = skel->maps.pinned_threads;
+	maps[3] = skel->maps.generation;
+	maps[4] = skel->maps.game_tgids;
+	maps[5] = skel->maps.game_cgroups;
+	maps[6] = skel->maps.comm_rules;
+	maps[7] = skel->maps.detected_threads;
+	maps[8] = skel->maps.partitions;
+	maps[9] = skel->maps.partition_stats;
+	maps[10] = skel->maps.thread_stats;
+}
+
+/*
+ * Pin BPF maps for the running scheduler. Maps adopted from the previous
+ * instance on reload are pinned already.
+ */
+static int pin_maps(struct scx_gamesched *skel)
+{
+	struct bpf_map *maps[NR_PINNED_MAPS];
+	u32 key;
+	int ret;
+
+	/* Create pin directory */
+	ret = mkdir(PIN_PATH, 0755);
+	if (ret && errno != EEXIST) {
+		fprintf(stderr, "Failed to create %s: %s\n", PIN_PATH, strerror(errno));
+		return -1;
+	}
+
+	/*
+	 * Publish what the CLI can't see in our rodata. Not carried over by
+	 * a reload, every instance pins its own.
+	 */
+	key = INFO_SCHED_FLAGS;
+	if (bpf_map_update_elem(bpf_map__fd(skel->maps.sched_info), &key,
+				&skel->rodata->sched_flags, BPF_ANY) < 0) {
+		fprintf(stderr, "Failed to publish sched_info: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	ret = bpf_map__pin(skel->maps.sched_info, PIN_SCHED_INFO);
+	if (ret) {
+		fprintf(stderr, "Failed to pin sched_info: %s\n", strerror(-ret));
+		return ret;
+	}
+
+	/* Pin each map */
+	skel_pinned_maps(skel, maps);
+	for (int i = 0; i < NR_PINNED_MAPS; i++) {
+		ret = bpf_map__pin(maps[i], pin_paths[i]);
+		if (ret) {
+			fprintf(stderr, "Failed to pin %s: %s\n",
+				bpf_map__name(maps[i]), strerror(-ret));
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Unpin BPF maps on exit.
+ */
+static void unpin_maps(void)
+{
+	for (int i = 0; i < NR_PINNED_MAPS; i++)
+		unlink(pin_paths[i]);
+	unlink(PIN_SCHED_INFO);
+	rmdir(PIN_PATH);
+}
+
+/*
+ * Pinned maps of the previous instance whose contents are copied over
+ * after the handoff, -1 if adopted as they are or missing.
+ */
+static int reload_fds[NR_PINNED_MAPS] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/*
+ * Check if a map type keeps one value per possible CPU.
+ */
+static bool map_type_percpu(enum bpf_map_type type)
+{
+	return type == BPF_MAP_TYPE_PERCPU_ARRAY ||
+	       type == BPF_MAP_TYPE_PERCPU_HASH ||
+	       type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+}
+
+/*
+ * Reload: adopt the pinned maps of the previous instance that match ours,
+ * so their contents carry over without a copy. Maps that only differ in
+ * type, capacity (-n) or flags are copied after the handoff instead.
+ * Must be called before the skeleton is loaded.
+ */
+static int reuse_pinned_maps(struct scx_gamesched *skel)
+{
+	struct bpf_map *maps[NR_PINNED_MAPS];
+	int ret;
+
+	skel_pinned_maps(skel, maps);
+	for (int i = 0; i < NR_PINNED_MAPS; i++) {
+		struct bpf_map_info info = {};
+		u32 len = sizeof(info);
+		int fd;
+
+		fd = bpf_obj_get(pin_paths[i]);
+		if (fd < 0)
+			continue;
+
+		if (bpf_map_get_info_by_fd(fd, &info, &len) < 0 ||
+		    info.key_size != bpf_map__key_size(maps[i]) ||
+		    info.value_size != bpf_map__value_size(maps[i])) {
+			fprintf(stderr, "Warning: layout of %s changed, not carrying it over\n",
+				bpf_map__name(maps[i]));
+			close(fd);
+			continue;
+		}
+
+		/* Per-CPU values don't convert to or from plain ones */
+		if (info.type != bpf_map__type(maps[i]) &&
+		    (map_type_percpu(info.type) ||
+		     map_type_percpu(bpf_map__type(maps[i])))) {
+			fprintf(stderr, "Warning: type of %s changed, not carrying it over\n",
+				bpf_map__name(maps[i]));
+			close(fd);
+			continue;
+		}
+
+		if (info.type != bpf_map__type(maps[i]) ||
+		    info.max_entries != bpf_map__max_entries(maps[i]) ||
+		    info.map_flags != bpf_map__map_flags(maps[i])) {
+			reload_fds[i] = fd;
+			continue;
+		}
+
+		close(fd);
+		ret = bpf_map__set_pin_path(maps[i], pin_paths[i]);
+		if (ret) {
+			fprintf(stderr, "Failed to reuse %s: %s\n",
+				bpf_map__name(maps[i]), strerror(-ret));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Copy every element of map @from into map @to, a batch at a time.
+ * @value_size is the size batch lookups fill per element, i.e. for a
+ * per-CPU map one 8-byte aligned value per possible CPU.
+ * Returns the number of elements copied or -errno.
+ */
+static int copy_map(int from, int to, u32 key_size, u32 value_size)
+{
+	u32 chunk = 256, total = 0;
+	u64 in = 0, out = 0;
+	bool first = true, done = false;
+	void *keys, *vals;
+	int ret = 0;
+
+	keys = calloc(chunk, key_size);
+	vals = calloc(chunk, value_size);
+	if (!keys || !vals) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	while (!done) {
+		u32 count = chunk;
+
+		if (bpf_map_lookup_batch(from, first ? NULL : &in, &out, keys, vals,
+					 &count, NULL) < 0) {
+			if (errno != ENOENT) {
+				ret = -errno;
+				goto out;
+			}
+			done = true;
+		}
+		if (count && bpf_map_update_batch(to, keys, vals, &count, NULL) < 0) {
+			ret = -errno;
+			goto out;
+		}
+		total += count;
+		in = out;
+		first = false;
+	}
+	ret = total;
+out:
+	free(vals);
+	free(keys);
+	return ret;
+}
+
+/*
+ * Reload: ask the running instance to detach and leave its maps to us,
+ * then copy over the maps reuse_pinned_maps() couldn't adopt and clear
+ * their pins for ours. Without a running instance, whatever is still
+ * pinned (e.g. after a crash) is taken over the same way.
+ *
+ * The writer lock is taken before the handoff and returned in @lock, for
+ * the caller to hold until its own ops are attached: no CLI command can
+ * publish into maps that are being copied and replaced in between.
+ */
+static int take_over(struct scx_gamesched *skel, int *lock)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct gamesched_ctl_req req = { .op = CTL_OP_HANDOFF };
+	struct gamesched_ctl_resp resp = {};
+	struct timeval tv = { .tv_sec = 1 };
+	struct bpf_map *maps[NR_PINNED_MAPS];
+	int fd;
+
+	/* Nothing to lock without pinned maps, e.g. on a first start */
+	*lock = lock_maps(true);
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+		goto err;
+	}
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", GAMESCHED_CTL_PATH);
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		if (send(fd, &req, sizeof(req), MSG_NOSIGNAL) < 0 ||
+		    recv(fd, &resp, sizeof(resp), 0) != sizeof(resp)) {
+			fprintf(stderr, "No handoff from the running instance\n");
+			close(fd);
+			goto err;
+		}
+		if (resp.status) {
+			fprintf(stderr, "Running instance refused the handoff: %s\n",
+				strerror(-resp.status));
+			close(fd);
+			goto err;
+		}
+		printf("Took over from the running instance\n");
+	}
+	close(fd);
+
+	skel_pinned_maps(skel, maps);
+	for (int i = 0; i < NR_PINNED_MAPS; i++) {
+		if (reload_fds[i] >= 0) {
+			u32 value_size = bpf_map__value_size(maps[i]);
+			int ret;
+
+			if (map_type_percpu(bpf_map__type(maps[i])))
+				value_size = ((value_size + 7) & ~7U) *
+					     libbpf_num_possible_cpus();
+			ret = copy_map(reload_fds[i], bpf_map__fd(maps[i]),
+				       bpf_map__key_size(maps[i]), value_size);
+
+			if (ret < 0)
+				fprintf(stderr, "Warning: failed to carry over %s: %s\n",
+					bpf_map__name(maps[i]), strerror(-ret));
+			else if (verbose)
+				printf("Carried over %d entries of %s\n", ret,
+				       bpf_map__name(maps[i]));
+			close(reload_fds[i]);
+			reload_fds[i] = -1;
+		}
+		if (!bpf_map__is_pinned(maps[i]))
+			unlink(pin_paths[i]);
+	}
+
+	unlink(PIN_SCHED_INFO);
+	return 0;
+
+err:
+	if (*lock >= 0)
+		close(*lock);
+	*lock = -1;
+	return -1;
+}
+
+/*
+ * Reload: attach, retrying while the previous instance is still being
+ * torn down.
+ */
+static struct bpf_link *attach_ops(struct scx_gamesched *skel)
+{
+	struct bpf_link *link;
+
+	for (int i = 0; i < 100; i++) {
+		link = bpf_map__attach_struct_ops(skel->maps.gamesched_ops);
+		if (link || errno != EBUSY)
+			break;
+		usleep(1000);
+	}
+
+	return link;
+}
+
+/*
+ * Add a game thread to the scheduler (uses pinned maps).
+ */
+static int cmd_add(int pid, const char *priority)
+{
+	struct gamesched_maps maps;
+	u32 prio;
+	u32 key = pid;
+
+	if (strcmp(priority, "render") == 0)
+		prio = PRIO_GAME_RENDER;
+	else if (strcmp(priority, "game") == 0)
+		prio = PRIO_GAME_OTHER;
+	else {
+		fprintf(stderr, "Invalid priority: %s (use 'render' or 'game')\n",
+			priority);
+		return -1;
+	}
+
+	if (open_pinned_maps(&maps) < 0)
+		return -1;
+
+	if (bpf_map_update_elem(maps.game_threads, &key, &prio, BPF_ANY) < 0) {
+		fprintf(stderr, "Failed to add PID %d: %s\n", pid, update_error(errno));
+		return -1;
+	}
+
+	if (bump_generation(&maps, GEN_REGISTRY) < 0)
+		return -1;
+
+	printf("Added PID %d with priority '%s'\n", pid, priority);
+	return 0;
+}
+
+/*
+ * Add or update a thread-name rule. Rules are shared by all registered
+ * processes; an existing rule with the same pattern is overwritten.
+ */
+static int add_comm_rule(struct gamesched_maps *maps, const char *pattern,
+			 u32 prio)
+{
+	struct gamesched_comm_rule rule;
+	int free_slot = -1;
+	u32 i;
+
+	if (!pattern[0] || strlen(pattern) >= COMM_LEN) {
+		fprintf(stderr, "Invalid thread-name pattern: '%s'\n", pattern);
+		return -1;
+	}
+
+	for (i = 0; i < MAX_COMM_RULES; i++) {
+		if (bpf_map_lookup_elem(maps->comm_rules, &i, &rule) < 0)
+			return -1;
+		if (!rule.pattern[0]) {
+			if (free_slot < 0)
+				free_slot = i;
+			continue;
+		}
+		if (strncmp(rule.pattern, pattern, COMM_LEN) == 0)
+			break;
+	}
+
+	if (i == MAX_COMM_RULES) {
+		if (free_slot < 0) {
+			fprintf(stderr, "Too many thread-name rules (max %d)\n",
+				MAX_COMM_RULES);
+			return -1;
+		}
+		i = free_slot;
+	}
+
+	memset(&rule, 0, sizeof(rule));
+	strncpy(rule.pattern, pattern, COMM_LEN - 1);
+	rule.prio = prio;
+
+	if (bpf_map_update_elem(maps->comm_rules, &i, &rule, BPF_ANY) < 0) {
+		fprintf(stderr, "Failed to add rule '%s': %s\n", pattern,
+			strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Parse and add a comma-separated list of PATTERN=PRIO thread-name rules.
+ */
+static int add_comm_rules(struct gamesched_maps *maps, const char *list)
+{
+	char *copy, *token, *saveptr;
+	int ret = 0;
+
+	copy = strdup(list);
+	if (!copy)
+		return -1;
+
+	for (token = strtok_r(copy, ",", &saveptr); token;
+	     token = strtok_r(NULL, ",", &saveptr)) {
+		char *eq = strchr(token, '=');
+		int prio;
+
+		if (!eq) {
+			fprintf(stderr, "Expected PATTERN=PRIO, got: %s\n", token);
+			ret = -1;
+			break;
+		}
+		*eq = '\0';
+
+		prio = parse_priority(eq + 1);
+		if (prio < 0) {
+			fprintf(stderr, "Invalid priority: %s\n", eq + 1);
+			ret = -1;
+			break;
+		}
+
+		ret = add_comm_rule(maps, token, prio);
+		if (ret < 0)
+			break;
+	}
+
+	free(copy);
+	return ret;
+}
+
+/*
+ * Add a whole process to the scheduler (uses pinned maps). Its current and
+ * future threads are classified in BPF without further CLI calls.
+ */
+static int cmd_add_tgid(int tgid, const char *priority, const char *comm)
+{
+	struct gamesched_maps maps;
+	u32 key = tgid;
+	int prio;
+
+	prio = parse_priority(priority);
+	if (prio != PRIO_GAME_RENDER && prio != PRIO_GAME_OTHER) {
+		fprintf(stderr, "Invalid priority: %s (use 'render' or 'game')\n",
+			priority);
+		return -1;
+	}
+
+	if (open_pinned_maps(&maps) < 0)
+		return -1;
+
+	if (comm && add_comm_rules(&maps, comm) < 0)
+		return -1;
+
+	if (bpf_map_update_elem(maps.game_tgids, &key, &prio, BPF_ANY) < 0) {
+		fprintf(stderr, "Failed to add TGID %d: %s\n", tgid, update_error(errno));
+		return -1;
+	}
+
+	if (bump_generation(&maps, GEN_REGISTRY) < 0)
+		return -1;
+
+	printf("Added TGID %d with priority '%s'%s%s\n", tgid, priority,
+	       comm ? ", rules " : "", comm ? comm : "");
+	return 0;
+}
+
+/*
+ * Resolve a cgroup path, absolute or relative to the cgroup v2 root, to the
+ * cgroup id BPF sees. Returns 0 on failure.
+ */
+static u64 cgroup_id(const char *path)
+{
+	char buf[PATH_MAX];
+	struct stat st;
+
+	if (strncmp(path, CGROUP_ROOT "/", strlen(CGROUP_ROOT) + 1) == 0)
+		snprintf(buf, sizeof(buf), "%s", path);
+	else
+		snprintf(buf, sizeof(buf), "%s/%s", CGROUP_ROOT,
+			 path[0] == '/' ? path + 1 : path);
+
+	if (stat(buf, &st) < 0) {
+		fprintf(stderr, "Invalid cgroup %s: %s\n", buf, strerror(errno));
+		return 0;
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		fprintf(stderr, "Invalid cgroup %s: not a directory\n", buf);
+		return 0;
+	}
+
+	/* On cgroup2 the directory inode number is the kernfs node id */
+	return st.st_ino;
+}
+
+/*
+ * Remove a game thread from the scheduler.
+ */
+static int cmd_remove(int pid)
+{
+	struct gamesched_maps maps;
+	u32 key = pid;
+
+	if (open_pinned_maps(&maps) < 0)
+		return -1;
+
+	bpf_map_delete_elem(maps.game_threads, &key);
+	bpf_map_delete_elem(maps.pinned_threads, &key);
+
+	if (bump_generation(&maps, GEN_REGISTRY) < 0)
+		return -1;
+
+	printf("Removed PID %d\n", pid);
+	return 0;
+}
+
+/*
+ * Remove a game process from the scheduler.
+ */
+static int cmd_remove_tgid(int tgid)
+{
+	struct gamesched_maps maps;
+	u32 key = tgid;
+
+	if (open_pinned_maps(&maps) < 0)
+		return -1;
+
+	bpf_map_delete_elem(maps.game_tgids, &key);
+
+	if (bump_generation(&maps, GEN_REGISTRY) < 0)
+		return -1;
+
+	printf("Removed TGID %d\n", tgid);
+	return 0;
+}
+
+/*
+ * Remove a game cgroup.
+ */
+static int cmd_remove_cgroup(const char *path)
+{
+	struct gamesched_maps maps;
+	u64 key;
+
+	key = cgroup_id(path);
+	if (!key)
+		return -1;
+
+	if (open_pinned_maps(&maps) < 0)
+		return -1;
+
+	bpf_map_delete_elem(maps.game_cgroups, &key);
+
+	if (bump_generation(&maps, GEN_REGISTRY) < 0)
+		return -1;
+
+	printf("Removed cgroup %s\n", path);
+	return 0;
+}
+
+/*
+ * Remove a thread-name rule.
+ */
+static int cmd_remove_comm(const char *pattern)
+{
+	struct gamesched_comm_rule rule;
+	struct gamesched_maps maps;
+	u32 i;
+
+	if (open_pinned_maps(&maps) < 0)
+		return -1;
+
+	for (i = 0; i < MAX_COMM_RULES; i++) {
+		if (bpf_map_lookup_elem(maps.comm_rules, &i, &rule) == 0 &&
+		    rule.pattern[0] && strncmp(rule.pattern, pattern, COMM_LEN) == 0)
+			break;
+	}
+
+	if (i == MAX_COMM_RULES) {
+		fprintf(stderr, "No thread-name rule '%s'\n", pattern);
+		return -1;
+	}
+
+	memset(&rule, 0, sizeof(rule));
+	bpf_map_update_elem(maps.comm_rules, &i, &rule, BPF_ANY);
+
+	if (bump_generation(&maps, GEN_REGISTRY) < 0)
+		return -1;
+
+	printf("Removed thread-name rule '%s'\n", pattern);
+	return 0;
+}
+
+/*
+ * Read the live copy of the isolation flags into @vals (MAX_CPUS entries)
+ * and the isolation generation into @gen.
+ */
+static int read_isolation(struct gamesched_maps *maps, u64 *gen, u32 *vals)
+{
+	u32 keys[2 * MAX_CPUS], all[2 * MAX_CPUS];
+	u32 idx = GEN_ISOLATION, count = 2 * MAX_CPUS, out;
+	int ret;
+
+	*gen = 0;
+	bpf_map_lookup_elem(maps->generation, &idx, gen);
+
+	ret = bpf_map_lookup_batch(maps->isolated_cpus, NULL, &out, keys, all,
+				   &count, NULL);
+	if (ret < 0 && errno != ENOENT) {
+		fprintf(stderr, "Failed to read isolated CPUs: %s\n", strerror(errno));
+		return -1;
+	}
+
+	memset(vals, 0, MAX_CPUS * sizeof(*vals));
+	for (u32 i = 0; i < count; i++) {
+		if (keys[i] >= ISOLATION_SLOT(*gen, 0) &&
+		    keys[i] < ISOLATION_SLOT(*gen, MAX_CPUS))
+			vals[keys[i] - ISOLATION_SLOT(*gen, 0)] = all[i];
+	}
+
+	return 0;
+}
+
+/*
+ * Install @vals (MAX_CPUS entries) as the isolation set: write them to the
+ * copy BPF isn't reading in one batch, then flip the generation to it.
+ * @gen is the isolation generation read_isolation() returned with them.
+ */
+static int write_isolation(struct gamesched_maps *maps, u64 gen, const u32 *vals)
+{
+	u32 keys[MAX_CPUS], count = MAX_CPUS, idx = GEN_ISOLATION;
+	u64 cur = 0;
+	int lock, ret = -1;
+
+	lock = lock_maps(true);
+	if (lock < 0) {
+		fprintf(stderr, "Failed to lock %s: %s\n", PIN_PATH, strerror(errno));
+		return -1;
+	}
+
+	/* @vals was built from generation @gen: don't overwrite a newer one */
+	bpf_map_lookup_elem(maps->generation, &idx, &cur);
+	if (cur != gen) {
+		fprintf(stderr, "CPU isolation changed concurrently, try again\n");
+		goto out;
+	}
+
+	for (u32 i = 0; i < MAX_CPUS; i++)
+		keys[i] = ISOLATION_SLOT(gen + 1, i);
+
+	if (bpf_map_update_batch(maps->isolated_cpus, keys, vals, &count, NULL) < 0) {
+		fprintf(stderr, "Failed to write isolated CPUs: %s\n", strerror(errno));
+		goto out;
+	}
+
+	ret = bump_generation_locked(maps, GEN_ISOLATION);
+out:
+	close(lock);
+	return ret;
+}
+
+/*
+ * What an isolated CPU drags along: nothing, its SMT siblings, or every
+ * CPU sharing its last-level cache.
+ */
+enum isolate_scope {
+	ISOLATE_CPUS,
+	ISOLATE_CORES,
+	ISOLATE_LLC,
+};
+
+/*
+ * Mark the CPUs in @cpu_list, widened to @scope, in @vals (MAX_CPUS
+ * entries).
+ */
+static int parse_isolation(const char *cpu_list, enum isolate_scope scope,
+			   u32 *vals)
+{
+	int cpus[MAX_CPUS], domain[MAX_CPUS];
+	int count, i, j, nr;
+
+	count = parse_cpu_list(cpu_list, cpus, MAX_CPUS);
+	if (count < 0) {
+		fprintf(stderr, "Failed to parse CPU list\n");
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (cpus[i] < 0 || cpus[i] >= MAX_CPUS) {
+			fprintf(stderr, "Invalid CPU %d\n", cpus[i]);
+			return -1;
+		}
+		/* CPUs of a named partition stay in it */
+		if (!vals[cpus[i]])
+			vals[cpus[i]] = 1;
+
+		if (scope == ISOLATE_CPUS)
+			continue;
+
+		nr = scope == ISOLATE_CORES ?
+			read_cpu_siblings(cpus[i], domain, MAX_CPUS) :
+			read_cpu_llc_cpus(cpus[i], domain, MAX_CPUS);
+		if (nr < 0) {
+			fprintf(stderr, "Failed to read the %s of CPU %d\n",
+				scope == ISOLATE_CORES ? "SMT siblings" : "LLC",
+				cpus[i]);
+			return -1;
+		}
+		for (j = 0; j < nr; j++) {
+			if (domain[j] >= 0 && domain[j] < MAX_CPUS && !vals[domain[j]])
+				vals[domain[j]] = 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Carry the CPUs of named partitions in @cur over into @vals, a new shared
+ * isolation set. Only `partition` commands change them.
+ */
+static void keep_partitions(const u32 *cur, u32 *vals)
+{
+	for (int i = 0; i < MAX_CPUS; i++) {
+		if (cur[i] > 1)
+			vals[i] = cur[i];
+	}
+}
+
+/*
+ * Set CPU isolation.
+ */
+static int cmd_isolate(const char *cpu_list, enum isolate_scope scope)
+{
+	struct gamesched_maps maps;
+	u32 vals[MAX_CPUS];
+	u64 gen;
+
+	if (open_pinned_maps(&maps) < 0 ||
+	    need_feature(&maps, GAMESCHED_FLAG_ISOLATION) < 0)
+		return -1;
+
+	if (strcmp(cpu_list, "--clear") == 0 || strcmp(cpu_list, "clear") == 0) {
+		u32 cur[MAX_CPUS];
+
+		if (read_isolation(&maps, &gen, cur) < 0)
+			return -1;
+		memset(vals, 0, sizeof(vals));
+		keep_partitions(cur, vals);
+		if (write_isolation(&maps, gen, vals) < 0)
+			return -1;
+		printf("Cleared CPU isolation\n");
+		return 0;
+	}
+
+	if (read_isolation(&maps, &gen, vals) < 0 ||
+	    parse_isolation(cpu_list, scope, vals) < 0 ||
+	    write_isolation(&maps, gen, vals) < 0)
+		return -1;
+
+	printf("Isolated CPUs: %s\n", cpu_list);
+	return 0;
+}
+
+/*
+ * Register every task of a cgroup and its descendants as a game.
+ */
+static int cmd_add_cgroup(const char *path, const char *priority,
+			  const char *isolate)
+{
+	struct gamesched_maps maps;
+	u64 key;
+	int prio;
+
+	prio = parse_priority(priority);
+	if (prio != PRIO_GAME_RENDER && prio != PRIO_GAME_OTHER) {
+		fprintf(stderr, "Invalid priority: %s (use 'render' or 'game')\n",
+			priority);
+		return -1;
+	}
+
+	key = cgroup_id(path);
+	if (!key)
+		return -1;
+
+	/* Refuse before registering anything */
+	if (open_pinned_maps(&maps) < 0 ||
+	    (isolate && need_feature(&maps, GAMESCHED_FLAG_ISOLATION) < 0))
+		return -1;
+
+	if (bpf_map_update_elem(maps.game_cgroups, &key, &prio, BPF_ANY) < 0) {
+		fprintf(stderr, "Failed to add cgroup %s: %s\n", path, update_error(errno));
+		return -1;
+	}
+
+	if (bump_generation(&maps, GEN_REGISTRY) < 0)
+		return -1;
+
+	printf("Added cgroup %s (id %llu) with priority '%s'\n", path,
+	       (unsigned long long)key, priority);
+
+	if (isolate)
+		return cmd_isolate(isolate, ISOLATE_CPUS);
+	return 0;
+}
+
+/*
+ * Get the nesting level of cgroup @path, the root being level 0.
+ */
+static u32 cgroup_level(const char *path)
+{
+	u32 level = 0;
+
+	if (strncmp(path, CGROUP_ROOT "/", strlen(CGROUP_ROOT) + 1) == 0)
+		path += strlen(CGROUP_ROOT);
+
+	for (const char *c = path; *c; c++) {
+		if (*c != '/' && (c == path || c[-1] == '/'))
+			level++;
+	}
+
+	return level;
+}
+
+/*
+ * Read the named partitions into @parts (MAX_PARTITIONS entries).
+ */
+static int read_partitions(struct gamesched_maps *maps,
+			   struct gamesched_partition *parts)
+{
+	struct gamesched_partition vals[MAX_PARTITIONS];
+	u32 keys[MAX_PARTITIONS], count = MAX_PARTITIONS, out;
+	int ret;
+
+	if (maps->partitions < 0) {
+		fprintf(stderr, "The running scheduler has no partitions, "
+			"reload it with -u\n");
+		return -1;
+	}
+
+	ret = bpf_map_lookup_batch(maps->partitions, NULL, &out, keys, vals,
+				   &count, NULL);
+	if (ret < 0 && errno != ENOENT) {
+		fprintf(stderr, "Failed to read partitions: %s\n", strerror(errno));
+		return -1;
+	}
+
+	memset(parts, 0, MAX_PARTITIONS * sizeof(*parts));
+	for (u32 i = 0; i < count; i++) {
+		if (keys[i] < MAX_PARTITIONS)
+			parts[keys[i]] = vals[i];
+	}
+
+	return 0;
+}
+
+/*
+ * Find the slot of partition @name, or with @alloc a free one if there is
+ * no such partition. Returns 0 if there is none.
+ */
+static u32 find_partition(const struct gamesched_partition *parts,
+			  const char *name, bool alloc)
+{
+	u32 free_slot = 0;
+
+	for (u32 i = 1; i < MAX_PARTITIONS; i++) {
+		if (!parts[i].name[0]) {
+			if (!free_slot)
+				free_slot = i;
+			continue;
+		}
+		if (strncmp(parts[i].name, name, PARTITION_NAME_LEN) == 0)
+			return i;
+	}
+
+	return alloc ? free_slot : 0;
+}
+
+/*
+ * Create or resize partition @name: isolate @cpu_list for the game tasks
+ * of @tgid or @cgroup, which then only use those CPUs.
+ */
+static int cmd_partition_add(const char *name, const char *cpu_list,
+			     int tgid, const char *cgroup)
+{
+	struct gamesched_partition parts[MAX_PARTITIONS], part = {};
+	struct gamesched_maps maps;
+	u32 vals[MAX_CPUS], cpus[MAX_CPUS] = {};
+	u32 slot;
+	u64 gen;
+
+	if (!name[0] || strlen(name) >= PARTITION_NAME_LEN) {
+		fprintf(stderr, "Invalid partition name: %s (1-%d characters)\n",
+			name, PARTITION_NAME_LEN - 1);
+		return -1;
+	}
+	snprintf(part.name, sizeof(part.name), "%s", name);
+
+	if (tgid > 0) {
+		part.owner_tgid = tgid;
+	} else {
+		part.owner_cgid = cgroup_id(cgroup);
+		if (!part.owner_cgid)
+			return -1;
+		part.cgroup_level = cgroup_level(cgroup);
+	}
+
+	if (parse_isolation(cpu_list, ISOLATE_CPUS, cpus) < 0)
+		return -1;
+
+	if (open_pinned_maps(&maps) < 0 ||
+	    need_feature(&maps, GAMESCHED_FLAG_ISOLATION) < 0 ||
+	    read_partitions(&maps, parts) < 0 ||
+	    read_isolation(&maps, &gen, vals) < 0)
+		return -1;
+
+	slot = find_partition(parts, name, true);
+	if (!slot) {
+		fprintf(stderr, "No free partition (at most %d)\n",
+			MAX_PARTITIONS - 1);
+		return -1;
+	}
+
+	for (int i = 0; i < MAX_CPUS; i++) {
+		if (!cpus[i]) {
+			/* Dropped from the partition */
+			if (vals[i] == slot + 1)
+				vals[i] = 0;
+			continue;
+		}
+		if (vals[i] > 1 && vals[i] != slot + 1 && vals[i] <= MAX_PARTITIONS) {
+			fprintf(stderr, "CPU %d belongs to partition %s\n", i,
+				parts[vals[i] - 1].name);
+			return -1;
+		}
+		vals[i] = slot + 1;
+	}
+
+	if (bpf_map_update_elem(maps.partitions, &slot, &part, BPF_ANY) < 0) {
+		fprintf(stderr, "Failed to add partition %s: %s\n", name,
+			strerror(errno));
+		return -1;
+	}
+
+	if (bump_generation(&maps, GEN_REGISTRY) < 0 ||
+	    write_isolation(&maps, gen, vals) < 0)
+		return -1;
+
+	printf("Partition %s: CPUs %s for ", name, cpu_list);
+	if (tgid > 0)
+		printf("TGID %d\n", tgid);
+	else
+		printf("cgroup %s\n", cgroup);
+	return 0;
+}
+
+/*
+ * Remove partition @name and release its CPUs.
+ */
+static int cmd_partition_remove(const char *name)
+{
+	struct gamesched_partition parts[MAX_PARTITIONS], part = {};
+	struct gamesched_maps maps;
+	u32 vals[MAX_CPUS];
+	u32 slot;
+	u64 gen;
+
+	if (open_pinned_maps(&maps) < 0 ||
+	    need_feature(&maps, GAMESCHED_FLAG_ISOLATION) < 0 ||
+	    read_partitions(&maps, parts) < 0 ||
+	    read_isolation(&maps, &gen, vals) < 0)
+		return -1;
+
+	slot = find_partition(parts, name, false);
+	if (!slot) {
+		fprintf(stderr, "No partition %s\n", name);
+		return -1;
+	}
+
+	for (int i = 0; i < MAX_CPUS; i++) {
+		if (vals[i] == slot + 1)
+			vals[i] = 0;
+	}
+
+	/* Release the CPUs before the slot, they never lack an owner */
+	if (write_isolation(&maps, gen, vals) < 0)
+		return -1;
+
+	if (bpf_map_update_elem(maps.partitions, &slot, &part, BPF_ANY) < 0) {
+		fprintf(stderr, "Failed to remove partition %s: %s\n", name,
+			strerror(errno));
+		return -1;
+	}
+
+	if (bump_generation(&maps, GEN_REGISTRY) < 0)
+		return -1;
+
+	printf("Removed partition %s\n", name);
+	return 0;
+}
+
+/*
+ * Pin a thread to a specific CPU.
+ */
+static int cmd_pin(int pid, int cpu)
+{
+	struct gamesched_maps maps;
+	u32 key = pid;
+	s32 value = cpu;
+
+	if (open_pinned_maps(&maps) < 0 ||
+	    need_feature(&maps, GAMESCHED_FLAG_PINNING) < 0)
+		return -1;
+
+	if (bpf_map_update_elem(maps.pinned_threads, &key, &value, BPF_ANY) < 0) {
+		fprintf(stderr, "Failed to pin PID %d to CPU %d: %s\n",
+			pid, cpu, update_error(errno));
+		return -1;
+	}
+
+	if (bump_generation(&maps, GEN_REGISTRY) < 0)
+		return -1;
+
+	printf("Pinned PID %d to CPU %d\n", pid, cpu);
+	return 0;
+}
+
+/*
+ * Map updates collected by apply, written with one batch syscall per map.
+ */
+struct map_batch {
+	char *keys;
+	char *vals;
+	u32 key_size;
+	u32 val_size;
+	u32 nr;
+	u32 cap;
+};
+
+struct apply_set {
+	struct map_batch threads, tgids, cgroups, pins;
+	struct map_batch del_threads, del_tgids, del_cgroups, del_pins;
+	char **rules;			/* --comm style rule lists */
+	int nr_rules;
+	bool isolate;
+	u32 isolation[MAX_CPUS];
+};
+
+/*
+ * Make room for @n more elements in @b.
+ */
+static int batch_reserve(struct map_batch *b, u32 n)
+{
+	u32 cap = b->nr + n;
+	char *keys, *vals;
+
+	if (cap <= b->cap)
+		return 0;
+
+	keys = realloc(b->keys, (size_t)cap * b->key_size);
+	vals = keys ? realloc(b->vals, (size_t)cap * (b->val_size ?: 1)) : NULL;
+	if (keys)
+		b->keys = keys;
+	if (!keys || !vals) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	b->vals = vals;
+	b->cap = cap;
+	return 0;
+}
+
+static int batch_add(struct map_batch *b, const void *key, const void *val)
+{
+	if (b->nr == b->cap && batch_reserve(b, b->cap ?: 64) < 0)
+		return -1;
+
+	memcpy(b->keys + (size_t)b->nr * b->key_size, key, b->key_size);
+	if (val)
+		memcpy(b->vals + (size_t)b->nr * b->val_size, val, b->val_size);
+	b->nr++;
+	return 0;
+}
+
+static void batch_free(struct map_batch *b)
+{
+	free(b->keys);
+	free(b->vals);
+}
+
+static int batch_update(int fd, struct map_batch *b, const char *what)
+{
+	u32 count = b->nr;
+
+	if (!b->nr)
+		return 0;
+
+	if (bpf_map_update_batch(fd, b->keys, b->vals, &count, NULL) < 0) {
+		fprintf(stderr, "Failed to update %s (%u of %u written): %s\n",
+			what, count, b->nr, update_error(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Delete a batch of keys. The kernel stops at the first missing key, so
+ * skip over those and continue with the rest.
+ */
+static int batch_delete(int fd, struct map_batch *b, const char *what)
+{
+	u32 done = 0;
+
+	while (done < b->nr) {
+		u32 count = b->nr - done;
+
+		if (bpf_map_delete_batch(fd, b->keys + (size_t)done * b->key_size,
+					 &count, NULL) == 0)
+			break;
+		if (errno != ENOENT) {
+			fprintf(stderr, "Failed to remove %s: %s\n", what, strerror(errno));
+			return -1;
+		}
+		done += count + 1;
+	}
+	return 0;
+}
+
+/*
+ * Read every element of map @fd into @b, a chunk at a time. A map the
+ * running scheduler doesn't have (@fd < 0) reads as empty.
+ */
+static int batch_read(int fd, struct map_batch *b, const char *what)
+{
+	u64 in = 0, out = 0;
+	bool first = true;
+
+	if (fd < 0)
+		return 0;
+
+	for (;;) {
+		u32 count = 256;
+		int ret;
+
+		if (batch_reserve(b, count) < 0)
+			return -1;
+
+		ret = bpf_map_lookup_batch(fd, first ? NULL : &in, &out,
+					   b->keys + (size_t)b->nr * b->key_size,
+					   b->vals + (size_t)b->nr * b->val_size,
+					   &count, NULL);
+		if (ret < 0 && errno != ENOENT) {
+			fprintf(stderr, "Failed to read %s: %s\n", what, strerror(errno));
+			return -1;
+		}
+		b->nr += count;
+		if (ret < 0)
+			return 0;
+		in = out;
+		first = false;
+	}
+}
+
+/*
+ * Parse a game priority for apply. Returns -1 if invalid.
+ */
+static int parse_game_priority(const char *str)
+{
+	int prio = str ? parse_priority(str) : -1;
+
+	if (prio != PRIO_GAME_RENDER && prio != PRIO_GAME_OTHER)
+		return -1;
+	return prio;
+}
+
+/*
+ * Parse one apply line into @set. Returns -1 with a message on error.
+ */
+static int apply_parse_line(struct apply_set *set, char *line)
+{
+	char *saveptr, *cmd, *arg, *arg2, *arg3;
+	int prio;
+
+	cmd = strtok_r(line, " \t\n", &saveptr);
+	if (!cmd || cmd[0] == '#')
+		return 0;
+	arg = strtok_r(NULL, " \t\n", &saveptr);
+	arg2 = strtok_r(NULL, " \t\n", &saveptr);
+	arg3 = strtok_r(NULL, " \t\n", &saveptr);
+
+	if (!arg) {
+		fprintf(stderr, "missing argument to '%s'\n", cmd);
+		return -1;
+	}
+
+	if (strcmp(cmd, "pid") == 0 || strcmp(cmd, "tgid") == 0) {
+		u32 key = atoi(arg);
+
+		prio = parse_game_priority(arg2);
+		if (!key || prio < 0) {
+			fprintf(stderr, "expected '%s ID render|game'\n", cmd);
+			return -1;
+		}
+		if (cmd[0] == 't' && arg3) {
+			char **rules = realloc(set->rules,
+					       (set->nr_rules + 1) * sizeof(*rules));
+
+			if (!rules || !(rules[set->nr_rules] = strdup(arg3))) {
+				fprintf(stderr, "Out of memory\n");
+				set->rules = rules ?: set->rules;
+				return -1;
+			}
+			set->rules = rules;
+			set->nr_rules++;
+		}
+		return batch_add(cmd[0] == 'p' ? &set->threads : &set->tgids,
+				 &key, &prio);
+	}
+
+	if (strcmp(cmd, "cgroup") == 0) {
+		u64 key = cgroup_id(arg);
+
+		prio = parse_game_priority(arg2);
+		if (prio < 0) {
+			fprintf(stderr, "expected 'cgroup PATH render|game'\n");
+			return -1;
+		}
+		if (!key)
+			return -1;
+		return batch_add(&set->cgroups, &key, &prio);
+	}
+
+	if (strcmp(cmd, "pin") == 0) {
+		u32 key = atoi(arg);
+		s32 cpu = arg2 ? atoi(arg2) : -1;
+
+		if (!key || cpu < 0 || cpu >= MAX_CPUS) {
+			fprintf(stderr, "expected 'pin PID CPU'\n");
+			return -1;
+		}
+		return batch_add(&set->pins, &key, &cpu);
+	}
+
+	if (strcmp(cmd, "unpin") == 0) {
+		u32 key = atoi(arg);
+
+		return batch_add(&set->del_pins, &key, NULL);
+	}
+
+	if (strcmp(cmd, "remove") == 0) {
+		if (!arg2) {
+			fprintf(stderr, "expected 'remove pid|tgid|cgroup ID'\n");
+			return -1;
+		}
+		if (strcmp(arg, "pid") == 0 || strcmp(arg, "tgid") == 0) {
+			u32 key = atoi(arg2);
+
+			return batch_add(arg[0] == 'p' ? &set->del_threads :
+					 &set->del_tgids, &key, NULL);
+		}
+		if (strcmp(arg, "cgroup") == 0) {
+			u64 key = cgroup_id(arg2);
+
+			if (!key)
+				return -1;
+			return batch_add(&set->del_cgroups, &key, NULL);
+		}
+		fprintf(stderr, "expected 'remove pid|tgid|cgroup ID'\n");
+		return -1;
+	}
+
+	if (strcmp(cmd, "isolate") == 0) {
+		set->isolate = true;
+		memset(set->isolation, 0, sizeof(set->isolation));
+		if (strcmp(arg, "none") == 0)
+			return 0;
+		return parse_isolation(arg, ISOLATE_CPUS, set->isolation);
+	}
+
+	fprintf(stderr, "unknown directive '%s'\n", cmd);
+	return -1;
+}
+
+/*
+ * Apply a whole configuration from @path ("-" for stdin) with one batch per
+ * map and a single generation bump, instead of one process per change.
+ * The file is parsed completely before anything is written.
+ */
+static int cmd_apply(const char *path)
+{
+	struct apply_set set = {
+		.threads	= { .key_size = sizeof(u32), .val_size = sizeof(u32) },
+		.tgids		= { .key_size = sizeof(u32), .val_size = sizeof(u32) },
+		.cgroups	= { .key_size = sizeof(u64), .val_size = sizeof(u32) },
+		.pins		= { .key_size = sizeof(u32), .val_size = sizeof(s32) },
+		.del_threads	= { .key_size = sizeof(u32) },
+		.del_tgids	= { .key_size = sizeof(u32) },
+		.del_cgroups	= { .key_size = sizeof(u64) },
+		.del_pins	= { .key_size = sizeof(u32) },
+	};
+	struct gamesched_maps maps;
+	size_t len = 0;
+	char *line = NULL;
+	int lineno = 0, ret = -1, i;
+	bool registry;
+	FILE *f;
+
+	f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while (getline(&line, &len, f) > 0) {
+		lineno++;
+		if (apply_parse_line(&set, line) < 0) {
+			fprintf(stderr, "%s:%d: invalid line\n", path, lineno);
+			goto out;
+		}
+	}
+
+	if (open_pinned_maps(&maps) < 0 ||
+	    (set.isolate && need_feature(&maps, GAMESCHED_FLAG_ISOLATION) < 0) ||
+	    ((set.pins.nr || set.del_pins.nr) &&
+	     need_feature(&maps, GAMESCHED_FLAG_PINNING) < 0))
+		goto out;
+
+	/* Removals first, so a file can re-register what it just removed */
+	if (batch_delete(maps.game_threads, &set.del_threads, "threads") < 0 ||
+	    batch_delete(maps.game_tgids, &set.del_tgids, "processes") < 0 ||
+	    batch_delete(maps.game_cgroups, &set.del_cgroups, "cgroups") < 0 ||
+	    batch_delete(maps.pinned_threads, &set.del_pins, "pins") < 0)
+		goto out;
+
+	for (i = 0; i < set.nr_rules; i++) {
+		if (add_comm_rules(&maps, set.rules[i]) < 0)
+			goto out;
+	}
+
+	if (batch_update(maps.game_threads, &set.threads, "threads") < 0 ||
+	    batch_update(maps.game_tgids, &set.tgids, "processes") < 0 ||
+	    batch_update(maps.game_cgroups, &set.cgroups, "cgroups") < 0 ||
+	    batch_update(maps.pinned_threads, &set.pins, "pins") < 0)
+		goto out;
+
+	registry = set.threads.nr || set.tgids.nr || set.cgroups.nr ||
+		   set.pins.nr || set.del_threads.nr || set.del_tgids.nr ||
+		   set.del_cgroups.nr || set.del_pins.nr || set.nr_rules;
+	if (registry && bump_generation(&maps, GEN_REGISTRY) < 0)
+		goto out;
+
+	if (set.isolate) {
+		u32 cur[MAX_CPUS];
+		u64 gen;
+
+		if (read_isolation(&maps, &gen, cur) < 0)
+			goto out;
+		keep_partitions(cur, set.isolation);
+		if (write_isolation(&maps, gen, set.isolation) < 0)
+			goto out;
+	}
+
+	printf("Applied %u threads, %u processes, %u cgroups, %u pins, "
+	       "%u removals%s\n",
+	       set.threads.nr, set.tgids.nr, set.cgroups.nr, set.pins.nr,
+	       set.del_threads.nr + set.del_tgids.nr + set.del_cgroups.nr +
+	       set.del_pins.nr, set.isolate ? ", isolation" : "");
+	ret = 0;
+out:
+	free(line);
+	if (f != stdin)
+		fclose(f);
+	for (i = 0; i < set.nr_rules; i++)
+		free(set.rules[i]);
+	free(set.rules);
+	batch_free(&set.threads);
+	batch_free(&set.tgids);
+	batch_free(&set.cgroups);
+	batch_free(&set.pins);
+	batch_free(&set.del_threads);
+	batch_free(&set.del_tgids);
+	batch_free(&set.del_cgroups);
+	batch_free(&set.del_pins);
+	return ret;
+}
+
+/*
+ * Print the CPUs whose isolation value in @vals is @match, or any
+ * isolation value if @match is 0, as a CPU list with ranges.
+ */
+static void print_cpu_set(const u32 *vals, u32 match)
+{
+	int first = 1;
+
+	for (int i = 0; i < MAX_CPUS; i++) {
+		int last = i;
+
+		if (!vals[i] || (match && vals[i] != match))
+			continue;
+
+		while (last + 1 < MAX_CPUS && vals[last + 1] &&
+		       (!match || vals[last + 1] == match))
+			last++;
+
+		printf("%s%d", first ? "" : ",", i);
+		if (last > i)
+			printf("-%d", last);
+		first = 0;
+		i = last;
+	}
+	if (first)
+		printf("(none)");
+}
+
+/*
+ * Print the named partitions @parts for status, with their CPUs from
+ * @iso_vals and their statistics.
+ */
+static int print_partitions(struct gamesched_maps *maps,
+			    const struct gamesched_partition *parts,
+			    const u32 *iso_vals)
+{
+	struct gamesched_partition_stats *percpu;
+	int nr_cpus = libbpf_num_possible_cpus();
+	int nr = 0;
+
+	percpu = calloc(nr_cpus, sizeof(*percpu));
+	if (!percpu)
+		return -1;
+
+	printf("\nPartitions:\n");
+	for (u32 slot = 1; slot < MAX_PARTITIONS; slot++) {
+		struct gamesched_partition_stats st = {};
+		const struct gamesched_partition *part = &parts[slot];
+
+		if (!part->name[0])
+			continue;
+
+		printf("  %.*s: CPUs ", PARTITION_NAME_LEN, part->name);
+		print_cpu_set(iso_vals, slot + 1);
+		if (part->owner_tgid)
+			printf(", owner TGID %u\n", part->owner_tgid);
+		else
+			printf(", owner cgroup %llu\n",
+			       (unsigned long long)part->owner_cgid);
+
+		if (bpf_map_lookup_elem(maps->partition_stats, &slot, percpu) == 0) {
+			for (int cpu = 0; cpu < nr_cpus; cpu++) {
+				st.nr_enqueued += percpu[cpu].nr_enqueued;
+				st.nr_dispatched += percpu[cpu].nr_dispatched;
+				st.nr_direct += percpu[cpu].nr_direct;
+				st.nr_intrusions += percpu[cpu].nr_intrusions;
+				st.busy_ns += percpu[cpu].busy_ns;
+			}
+		}
+		printf("    queued=%llu dispatched=%llu direct=%llu "
+		       "intrusions=%llu busy=%.1fs\n",
+		       (unsigned long long)st.nr_enqueued,
+		       (unsigned long long)st.nr_dispatched,
+		       (unsigned long long)st.nr_direct,
+		       (unsigned long long)st.nr_intrusions, st.busy_ns / 1e9);
+		nr++;
+	}
+	if (!nr)
+		printf("  (none)\n");
+
+	free(percpu);
+	return 0;
+}
+
+/*
+ * A thread shown by status: its registration, pin and live data from BPF,
+ * merged by pid.
+ */
+struct status_thread {
+	u32 pid;
+	u32 prio;		/* registered priority, NR_PRIO_LEVELS if none */
+	s32 pinned_cpu;		/* -1 if not pinned */
+	bool live;		/* @stats is valid, the thread ran */
+	struct gamesched_thread_stats stats;
+};
+
+static int cmp_status_thread(const void *a, const void *b)
+{
+	const struct status_thread *x = a, *y = b;
+
+	return x->pid < y->pid ? -1 : x->pid > y->pid;
+}
+
+/*
+ * Merge the registered, pinned and live threads into one row per pid,
+ * sorted by pid. Returns the number of rows or -1.
+ */
+static int merge_status_threads(const struct map_batch *threads,
+				const struct map_batch *pins,
+				const struct map_batch *live,
+				struct status_thread **rowsp)
+{
+	u32 nr = 0, total = threads->nr + pins->nr + live->nr, out = 0;
+	struct status_thread *rows;
+
+	rows = calloc(total ?: 1, sizeof(*rows));
+	if (!rows) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+
+	for (u32 i = 0; i < threads->nr; i++, nr++) {
+		rows[nr].pid = ((u32 *)threads->keys)[i];
+		rows[nr].prio = ((u32 *)threads->vals)[i];
+		rows[nr].pinned_cpu = -1;
+	}
+	for (u32 i = 0; i < pins->nr; i++, nr++) {
+		rows[nr].pid = ((u32 *)pins->keys)[i];
+		rows[nr].prio = NR_PRIO_LEVELS;
+		rows[nr].pinned_cpu = ((s32 *)pins->vals)[i];
+	}
+	for (u32 i = 0; i < live->nr; i++, nr++) {
+		rows[nr].pid = ((u32 *)live->keys)[i];
+		rows[nr].prio = NR_PRIO_LEVELS;
+		rows[nr].pinned_cpu = -1;
+		rows[nr].live = true;
+		rows[nr].stats = ((struct gamesched_thread_stats *)live->vals)[i];
+	}
+
+	qsort(rows, nr, sizeof(*rows), cmp_status_thread);
+
+	for (u32 i = 0; i < nr; i++) {
+		struct status_thread *row = &rows[i];
+
+		if (out && rows[out - 1].pid == row->pid) {
+			struct status_thread *dst = &rows[out - 1];
+
+			if (row->prio < NR_PRIO_LEVELS)
+				dst->prio = row->prio;
+			if (row->pinned_cpu >= 0)
+				dst->pinned_cpu = row->pinned_cpu;
+			if (row->live) {
+				dst->live = true;
+				dst->stats = row->stats;
+			}
+			continue;
+		}
+		rows[out++] = *row;
+	}
+
+	*rowsp = rows;
+	return out;
+}
+
+/*
+ * Print one line per thread with its class, pin and live placement data.
+ */
+static void print_status_threads(const struct status_thread *rows, int nr)
+{
+	printf("Game Threads:\n");
+	if (!nr) {
+		printf("  (none)\n");
+		return;
+	}
+
+	printf("  %7s %7s %-10s %4s %4s %10s %10s %9s %6s %6s\n",
+	       "PID", "TGID", "PRIO", "PIN", "CPU", "RUN", "WAIT",
+	       "AVG_WAIT", "MIGR", "REDIR");
+
+	for (int i = 0; i < nr; i++) {
+		const struct status_thread *row = &rows[i];
+		const struct gamesched_thread_stats *st = &row->stats;
+		u32 prio = row->live ? st->prio : row->prio;
+		char tgid[16] = "-", pin[16] = "-", cpu[16] = "-";
+
+		if (row->live)
+			snprintf(tgid, sizeof(tgid), "%u", st->tgid);
+		if (row->pinned_cpu >= 0)
+			snprintf(pin, sizeof(pin), "%d", row->pinned_cpu);
+		if (row->live)
+			snprintf(cpu, sizeof(cpu), "%d", st->last_cpu);
+
+		printf("  %7u %7s %-10s %4s %4s", row->pid, tgid,
+		       prio < NR_PRIO_LEVELS ? prio_names[prio] : "-", pin, cpu);
+		if (row->live)
+			printf(" %9.3fs %8.2fms %7.1fus %6u %6u\n",
+			       st->runtime_ns / 1e9, st->wait_ns / 1e6,
+			       st->nr_runs ? st->wait_ns / 1e3 / st->nr_runs : 0.0,
+			       st->nr_migrations, st->nr_redirects);
+		else
+			printf(" %10s %10s %9s %6s %6s\n", "-", "-", "-", "-", "-");
+	}
+}
+
+/*
+ * Print every possible CPU with its LLC, SMT siblings, isolation and the
+ * number of live threads that last ran on it.
+ */
+static void print_topology(const u32 *iso_vals,
+			   const struct gamesched_partition *parts,
+			   const struct status_thread *rows, int nr_rows)
+{
+	int nr_cpus = libbpf_num_possible_cpus();
+
+	if (nr_cpus > MAX_CPUS)
+		nr_cpus = MAX_CPUS;
+
+	printf("\nCPU Topology:\n");
+	printf("  %4s %4s %-12s %-16s %s\n", "CPU", "LLC", "SIBLINGS",
+	       "ISOLATION", "THREADS");
+
+	for (int cpu = 0; cpu < nr_cpus; cpu++) {
+		char sibs[32] = "-", llc[24] = "-", iso[32] = "-";
+		int cpus[8], nr_sibs, len = 0, nr_threads = 0;
+		long id = read_cpu_llc(cpu);
+		u32 val = iso_vals[cpu];
+
+		nr_sibs = read_cpu_siblings(cpu, cpus, 8);
+		for (int i = 0; i < nr_sibs && len < (int)sizeof(sibs); i++) {
+			if (cpus[i] != cpu)
+				len += snprintf(sibs + len, sizeof(sibs) - len,
+						"%s%d", len ? "," : "", cpus[i]);
+		}
+		if (id >= 0)
+			snprintf(llc, sizeof(llc), "%ld", id);
+		if (val == 1)
+			strcpy(iso, "isolated");
+		else if (val > 1 && val <= MAX_PARTITIONS)
+			snprintf(iso, sizeof(iso), "%.*s", PARTITION_NAME_LEN,
+				 parts[val - 1].name);
+
+		for (int i = 0; i < nr_rows; i++)
+			if (rows[i].live && rows[i].stats.last_cpu == cpu)
+				nr_threads++;
+
+		printf("  %4d %4s %-12s %-16s %d\n", cpu, llc, sibs, iso,
+		       nr_threads);
+	}
+}
+
+/*
+ * Show current status. Every map is read with batch lookups, so this
+ * stays cheap with thousands of registered threads.
+ */
+static int cmd_status(void)
+{
+	struct map_batch threads = { .key_size = sizeof(u32), .val_size = sizeof(u32) };
+	struct map_batch pins = { .key_size = sizeof(u32), .val_size = sizeof(s32) };
+	struct map_batch live = {
+		.key_size = sizeof(u32),
+		.val_size = sizeof(struct gamesched_thread_stats),
+	};
+	struct map_batch tgids = { .key_size = sizeof(u32), .val_size = sizeof(u32) };
+	struct map_batch cgroups = { .key_size = sizeof(u64), .val_size = sizeof(u32) };
+	struct map_batch rules = {
+		.key_size = sizeof(u32),
+		.val_size = sizeof(struct gamesched_comm_rule),
+	};
+	struct map_batch detected = {
+		.key_size = sizeof(u32),
+		.val_size = sizeof(struct gamesched_detected),
+	};
+	struct gamesched_partition parts[MAX_PARTITIONS] = {};
+	struct status_thread *rows = NULL;
+	struct gamesched_maps maps;
+	u32 iso_vals[MAX_CPUS];
+	int nr_rows, ret = -1;
+	u64 iso_gen;
+	u32 i;
+
+	if (open_pinned_maps(&maps) < 0)
+		return -1;
+
+	if (batch_read(maps.game_threads, &threads, "game threads") < 0 ||
+	    batch_read(maps.pinned_threads, &pins, "pins") < 0 ||
+	    batch_read(maps.thread_stats, &live, "thread stats") < 0 ||
+	    batch_read(maps.game_tgids, &tgids, "game processes") < 0 ||
+	    batch_read(maps.game_cgroups, &cgroups, "game cgroups") < 0 ||
+	    batch_read(maps.comm_rules, &rules, "thread-name rules") < 0 ||
+	    batch_read(maps.detected_threads, &detected, "detected threads") < 0 ||
+	    read_isolation(&maps, &iso_gen, iso_vals) < 0 ||
+	    (maps.partitions >= 0 && read_partitions(&maps, parts) < 0))
+		goto out;
+
+	nr_rows = merge_status_threads(&threads, &pins, &live, &rows);
+	if (nr_rows < 0)
+		goto out;
+
+	printf("=== GameSched Status ===\n\n");
+
+	print_status_threads(rows, nr_rows);
+
+	/* Game processes */
+	printf("\nGame Processes:\n");
+	for (i = 0; i < tgids.nr; i++) {
+		u32 prio = ((u32 *)tgids.vals)[i];
+
+		if (prio < NR_PRIO_LEVELS)
+			printf("  TGID %u: priority=%s\n",
+			       ((u32 *)tgids.keys)[i], prio_names[prio]);
+	}
+
+	for (i = 0; i < cgroups.nr; i++) {
+		u32 prio = ((u32 *)cgroups.vals)[i];
+
+		if (prio < NR_PRIO_LEVELS)
+			printf("  cgroup %llu: priority=%s\n",
+			       (unsigned long long)((u64 *)cgroups.keys)[i],
+			       prio_names[prio]);
+	}
+
+	for (i = 0; i < rules.nr; i++) {
+		const struct gamesched_comm_rule *rule =
+			&((struct gamesched_comm_rule *)rules.vals)[i];
+
+		if (rule->pattern[0] && rule->prio < NR_PRIO_LEVELS)
+			printf("  rule: %.*s* -> %s\n", COMM_LEN, rule->pattern,
+			       prio_names[rule->prio]);
+	}
+
+	/* Render threads found by the frame-cadence detector */
+	printf("\nDetected Render Threads:\n");
+	int nr_detected = 0;
+	for (i = 0; i < detected.nr; i++) {
+		const struct gamesched_detected *det =
+			&((struct gamesched_detected *)detected.vals)[i];
+
+		if (!det->period_ns)
+			continue;
+		printf("  PID %u (TGID %u): frame period %.2fms (%.1f Hz), "
+		       "jitter %.2fms, run %.2fms\n",
+		       ((u32 *)detected.keys)[i], det->tgid, det->period_ns / 1e6,
+		       1e9 / det->period_ns, det->jitter_ns / 1e6,
+		       det->run_ns / 1e6);
+		nr_detected++;
+	}
+	if (!nr_detected)
+		printf("  (none)\n");
+
+	/* Isolated CPUs, shared and partitioned */
+	printf("\nIsolated CPUs: ");
+	print_cpu_set(iso_vals, 0);
+	printf("\n");
+
+	print_topology(iso_vals, parts, rows, nr_rows);
+
+	/* An older instance without partitions has nothing more to show */
+	ret = maps.partitions >= 0 ? print_partitions(&maps, parts, iso_vals) : 0;
+out:
+	free(rows);
+	batch_free(&threads);
+	batch_free(&pins);
+	batch_free(&live);
+	batch_free(&tgids);
+	batch_free(&cgroups);
+	batch_free(&rules);
+	batch_free(&detected);
+	return ret;
+}
+
+/*
+ * Read the per-CPU statistics into @percpu (one entry per possible CPU) and
+ * their sum into @total.
+ */
+static int read_stats(struct scx_gamesched *skel, int nr_cpus,
+		      struct gamesched_stats *percpu,
+		      struct gamesched_stats *total)
+{
+	u32 zero = 0;
+	int cpu, i;
+
+	if (bpf_map_lookup_elem(bpf_map__fd(skel->maps.stats), &zero, percpu) < 0)
+		return -1;
+
+	/* struct gamesched_stats is all u64 counters */
+	memset(total, 0, sizeof(*total));
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		const u64 *src = (const u64 *)&percpu[cpu];
+		u64 *dst = (u64 *)total;
+
+		for (i = 0; i < sizeof(*total) / sizeof(u64); i++)
+			dst[i] += src[i];
+	}
+
+	return 0;
+}
+
+/*
+ * Read the per-CPU latency histograms and sum them into @total.
+ */
+static int read_lat_hist(struct scx_gamesched *skel, int nr_cpus,
+			 struct gamesched_lat_hist *percpu,
+			 struct gamesched_lat_hist *total)
+{
+	u32 zero = 0;
+	int cpu, prio, b;
+
+	if (bpf_map_lookup_elem(bpf_map__fd(skel->maps.lat_hists), &zero, percpu) < 0)
+		return -1;
+
+	memset(total, 0, sizeof(*total));
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		for (prio = 0; prio < NR_PRIO_LEVELS; prio++)
+			for (b = 0; b < NR_LAT_BUCKETS; b++)
+				total->buckets[prio][b] += percpu[cpu].buckets[prio][b];
+
+	return 0;
+}
+
+/*
+ * Get the upper bound (ns) of the bucket holding the given percentile,
+ * expressed in parts per 10000, of a histogram with @count samples.
+ */
+static u64 hist_percentile(const u64 *buckets, u64 count, u64 permyriad)
+{
+	u64 target = (count * permyriad + 9999) / 10000;
+	u64 seen = 0;
+	int b;
+
+	for (b = 0; b < NR_LAT_BUCKETS; b++) {
+		seen += buckets[b];
+		if (seen >= target)
+			return 1ULL << (b + 1);
+	}
+
+	return 1ULL << NR_LAT_BUCKETS;
+}
+
+/*
+ * Print the latency percentiles of the samples recorded since @prev.
+ * Values are upper bounds of log2 buckets.
+ */
+static void print_latency(const struct gamesched_lat_hist *cur,
+			  const struct gamesched_lat_hist *prev)
+{
+	int prio, b;
+
+	for (prio = 0; prio < NR_PRIO_LEVELS; prio++) {
+		u64 delta[NR_LAT_BUCKETS];
+		u64 count = 0;
+		int max_b = 0;
+
+		for (b = 0; b < NR_LAT_BUCKETS; b++) {
+			delta[b] = cur->buckets[prio][b] - prev->buckets[prio][b];
+			count += delta[b];
+			if (delta[b])
+				max_b = b;
+		}
+
+		if (!count)
+			continue;
+
+		printf("  lat %-10s n=%lu p50<=%.1fus p99<=%.1fus p99.9<=%.1fus max<=%.1fus\n",
+		       prio_names[prio], count,
+		       hist_percentile(delta, count, 5000) / 1000.0,
+		       hist_percentile(delta, count, 9900) / 1000.0,
+		       hist_percentile(delta, count, 9990) / 1000.0,
+		       (1ULL << (max_b + 1)) / 1000.0);
+	}
+}
+
+/*
+ * Print one set of counters. @label is NULL for the totals line.
+ */
+static void print_stats(struct scx_gamesched *skel, const char *label,
+			const struct gamesched_stats *st)
+{
+	if (label)
+		printf("  %-6s", label);
+
+	printf("game=%lu normal=%lu direct=%lu pinned=%lu isolated_redirects=%lu isolated_blocked=%lu",
+	       st->nr_enqueued[PRIO_GAME_RENDER] + st->nr_enqueued[PRIO_GAME_OTHER],
+	       st->nr_enqueued[PRIO_NORMAL] + st->nr_enqueued[PRIO_BACKGROUND],
+	       st->nr_direct_dispatched,
+	       st->nr_pinned_dispatched,
+	       st->nr_isolated_violations,
+	       st->nr_isolated_blocked);
+	if (skel->rodata->llc_shards)
+		printf(" local=%lu stolen=%lu",
+		       st->nr_local_dispatched,
+		       st->nr_stolen_dispatched);
+	printf(" preempt=%lu", st->nr_preemptions);
+	printf(" budget=%lu aged=%lu", st->nr_budget_dispatched,
+	       st->nr_aged_dispatched);
+	if (skel->rodata->trace_enabled)
+		printf(" trace_dropped=%lu", st->nr_trace_dropped);
+	if (skel->rodata->boost_wakees)
+		printf(" boosts=%lu", st->nr_boosts);
+	if (skel->rodata->quiet_siblings)
+		printf(" quiet=%lu", st->nr_sibling_quiet);
+	if (skel->rodata->hybrid_steering)
+		printf(" capacity_fallbacks=%lu", st->nr_capacity_fallbacks);
+	printf("\n");
+
+	if (!label)
+		printf("  enq render/game/normal/bg=%lu/%lu/%lu/%lu disp=%lu/%lu/%lu/%lu\n",
+		       st->nr_enqueued[PRIO_GAME_RENDER],
+		       st->nr_enqueued[PRIO_GAME_OTHER],
+		       st->nr_enqueued[PRIO_NORMAL],
+		       st->nr_enqueued[PRIO_BACKGROUND],
+		       st->nr_dispatched[PRIO_GAME_RENDER],
+		       st->nr_dispatched[PRIO_GAME_OTHER],
+		       st->nr_dispatched[PRIO_NORMAL],
+		       st->nr_dispatched[PRIO_BACKGROUND]);
+}
+
+/*
+ * Print the utilization of each placement domain over the last @elapsed_ns
+ * and the spill counts. @prev_busy carries the busy time across calls.
+ */
+static void print_domains(struct scx_gamesched *skel,
+			  const struct gamesched_stats *percpu, int nr_cpus,
+			  const struct gamesched_stats *total,
+			  u64 *prev_busy, u64 elapsed_ns)
+{
+	u64 busy[NR_DOMAINS] = {};
+	int nr[NR_DOMAINS] = {};
+	int cpu, dom;
+
+	for (cpu = 0; cpu < nr_cpus && cpu < MAX_CPUS; cpu++) {
+		dom = skel->rodata->cpu_domain[cpu];
+		if (dom >= NR_DOMAINS)
+			continue;
+		busy[dom] += percpu[cpu].busy_ns;
+		nr[dom]++;
+	}
+
+	printf("  domain");
+	for (dom = 0; dom < NR_DOMAINS; dom++) {
+		double util = 0;
+
+		if (nr[dom] && elapsed_ns)
+			util = 100.0 * (busy[dom] - prev_busy[dom]) /
+			       ((double)elapsed_ns * nr[dom]);
+		printf(" %s=%.1f%%", dom == DOM_GAME ? "game" : "system", util);
+		prev_busy[dom] = busy[dom];
+	}
+	printf(" spills game=%lu system=%lu\n",
+	       total->nr_domain_spills[DOM_GAME],
+	       total->nr_domain_spills[DOM_SYSTEM]);
+}
+
+/*
+ * Print the perf target last requested on each CPU, in percent of max.
+ */
+static void print_cpuperf(struct scx_gamesched *skel, int nr_cpus)
+{
+	int cpu;
+
+	printf("  perf");
+	for (cpu = 0; cpu < nr_cpus && cpu < MAX_CPUS; cpu++)
+		printf(" %d:%u%%", cpu,
+		       skel->bss->cpu_perf_target[cpu] * 100 / PERF_SCALE);
+	printf("\n");
+}
+
+/*
+ * Control socket: lets agents reclassify threads through the running
+ * scheduler without a process and a set of bpf_obj_get()s per change.
+ */
+
+/* Fill @maps with the fds of the scheduler's own maps */
+static void skel_maps(struct scx_gamesched *skel, struct gamesched_maps *maps)
+{
+	maps->game_threads = bpf_map__fd(skel->maps.game_threads);
+	maps->isolated_cpus = bpf_map__fd(skel->maps.isolated_cpus);
+	maps->pinned_threads = bpf_map__fd(skel->maps.pinned_threads);
+	maps->generation = bpf_map__fd(skel->maps.generation);
+	maps->game_tgids = bpf_map__fd(skel->maps.game_tgids);
+	maps->game_cgroups = bpf_map__fd(skel->maps.game_cgroups);
+	maps->comm_rules = bpf_map__fd(skel->maps.comm_rules);
+	maps->detected_threads = bpf_map__fd(skel->maps.detected_threads);
+	maps->partitions = bpf_map__fd(skel->maps.partitions);
+	maps->partition_stats = bpf_map__fd(skel->maps.partition_stats);
+	maps->thread_stats = bpf_map__fd(skel->maps.thread_stats);
+	maps->sched_flags = skel->rodata->sched_flags;
+}
+
+/*
+ * IRQ and workqueue steering (-I). While CPUs are isolated, the affinity
+ * of every IRQ, the default affinity of new IRQs and the unbound workqueue
+ * cpumask point at the other CPUs. The original values are saved on the
+ * first change and written back once isolation is cleared, and on exit.
+ */
+#define IRQ_DEFAULT_AFFINITY	"/proc/irq/default_smp_affinity"
+#define WQ_CPUMASK		"/sys/devices/virtual/workqueue/cpumask"
+
+struct saved_affinity {
+	char path[64];
+	char value[1536];
+	bool list;		/* CPU list rather than hex mask format */
+};
+
+static struct saved_affinity *saved_affinity;
+static int nr_saved_affinity;
+static u64 steered_gen = ~0ULL;
+
+static int read_line(const char *path, char *buf, size_t len)
+{
+	FILE *f;
+	int ret = -1;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	if (fgets(buf, len, f)) {
+		buf[strcspn(buf, "\n")] = '\0';
+		ret = 0;
+	}
+
+	fclose(f);
+	return ret;
+}
+
+static int write_line(const char *path, const char *val)
+{
+	FILE *f;
+	int ret;
+
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+
+	/* procfs reports a rejected write when the buffer is flushed */
+	ret = fputs(val, f) < 0 ? -1 : 0;
+	if (fclose(f))
+		ret = -1;
+	return ret;
+}
+
+static void save_affinity(const char *path, bool list)
+{
+	struct saved_affinity *sa;
+
+	sa = realloc(saved_affinity, (nr_saved_affinity + 1) * sizeof(*sa));
+	if (!sa)
+		return;
+	saved_affinity = sa;
+
+	sa = &saved_affinity[nr_saved_affinity];
+	snprintf(sa->path, sizeof(sa->path), "%s", path);
+	sa->list = list;
+	if (read_line(path, sa->value, sizeof(sa->value)) == 0)
+		nr_saved_affinity++;
+}
+
+static void save_affinities(void)
+{
+	struct dirent *de;
+	char path[64];
+	DIR *dir;
+
+	save_affinity(IRQ_DEFAULT_AFFINITY, false);
+	save_affinity(WQ_CPUMASK, false);
+
+	dir = opendir("/proc/irq");
+	if (!dir)
+		return;
+
+	while ((de = readdir(dir))) {
+		if (!isdigit(de->d_name[0]))
+			continue;
+		snprintf(path, sizeof(path), "/proc/irq/%.16s/smp_affinity_list",
+			 de->d_name);
+		save_affinity(path, true);
+	}
+	closedir(dir);
+}
+
+static void restore_noise(void)
+{
+	for (int i = 0; i < nr_saved_affinity; i++)
+		write_line(saved_affinity[i].path, saved_affinity[i].value);
+
+	free(saved_affinity);
+	saved_affinity = NULL;
+	nr_saved_affinity = 0;
+}
+
+/*
+ * Point IRQs and unbound workqueues at the CPUs that aren't isolated, once
+ * per isolation generation.
+ */
+static void steer_noise(struct scx_gamesched *skel)
+{
+	struct gamesched_maps maps;
+	int nr_cpus = libbpf_num_possible_cpus();
+	int nr_isolated = 0, failed = 0;
+	char list[1536] = "", mask[128] = "";
+	size_t len = 0;
+	u32 vals[MAX_CPUS];
+	u64 gen;
+
+	skel_maps(skel, &maps);
+	if (read_isolation(&maps, &gen, vals) < 0 || gen == steered_gen)
+		return;
+	steered_gen = gen;
+
+	if (nr_cpus > MAX_CPUS)
+		nr_cpus = MAX_CPUS;
+	for (int cpu = 0; cpu < nr_cpus; cpu++)
+		nr_isolated += !!vals[cpu];
+
+	if (!nr_isolated || nr_isolated == nr_cpus) {
+		restore_noise();
+		return;
+	}
+	if (!saved_affinity)
+		save_affinities();
+
+	for (int cpu = 0; cpu < nr_cpus; cpu++) {
+		if (!vals[cpu])
+			len += snprintf(list + len, sizeof(list) - len, "%s%d",
+					len ? "," : "", cpu);
+	}
+
+	/* Hex mask in 32-bit groups, most significant first */
+	len = 0;
+	for (int group = (nr_cpus - 1) / 32; group >= 0; group--) {
+		u32 bits = 0;
+
+		for (int bit = 0; bit < 32 && group * 32 + bit < nr_cpus; bit++) {
+			if (!vals[group * 32 + bit])
+				bits |= 1U << bit;
+		}
+		len += snprintf(mask + len, sizeof(mask) - len, "%s%08x",
+				len ? "," : "", bits);
+	}
+
+	/* Per-CPU and kernel-managed IRQs refuse to move */
+	for (int i = 0; i < nr_saved_affinity; i++) {
+		if (write_line(saved_affinity[i].path,
+			       saved_affinity[i].list ? list : mask) < 0)
+			failed++;
+	}
+
+	printf("Steered IRQs and unbound workqueues to CPUs %s", list);
+	if (failed)
+		printf(" (%d left in place)", failed);
+	printf("\n");
+}
+
+/*
+ * Print what ran on each isolated CPU besides game work.
  */
-static int parse_cpu_list(const char *str, int *cpus, int max_cpus)
+static void print_isolation(struct scx_gamesched *skel,
+			    const struct gamesched_stats *percpu, int nr_cpus)
 {
-	char *copy, *token, *saveptr;
-	int count = 0;
+	struct gamesched_maps maps;
+	u32 vals[MAX_CPUS];
+	bool any = false;
+	u64 gen;
+
+	skel_maps(skel, &maps);
+	if (read_isolation(&maps, &gen, vals) < 0)
+		return;
+
+	for (int cpu = 0; cpu < nr_cpus && cpu < MAX_CPUS; cpu++) {
+		if (!vals[cpu])
+			continue;
+		if (!any)
+			printf("  isolated kthreads/other:");
+		printf(" cpu%d=%lu/%lu", cpu, percpu[cpu].nr_isolated_kthreads,
+		       percpu[cpu].nr_isolated_intrusions);
+		any = true;
+	}
+	if (any)
+		printf("\n");
+}
 
-	copy = strdup(str);
-	if (!copy)
+static int ctl_listen(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
 		return -1;
 
-	token = strtok_r(copy, ",", &saveptr);
-	while (token && count < max_cpus) {
-		cpus[count++] = atoi(token);
-		token = strtok_r(NULL, ",", &saveptr);
+	/* pin_maps() succeeded, so a leftover socket is stale */
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", GAMESCHED_CTL_PATH);
+	unlink(GAMESCHED_CTL_PATH);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    chmod(GAMESCHED_CTL_PATH, 0600) < 0 || listen(fd, 16) < 0) {
+		close(fd);
+		return -1;
 	}
 
-	free(copy);
-	return count;
+	return fd;
 }
 
-/*
- * Open pinned BPF maps for CLI commands.
- * Returns 0 on success, -1 if scheduler is not running.
- */
-static int open_pinned_maps(int *game_threads_fd, int *isolated_cpus_fd,
-			    int *pinned_threads_fd)
+/* Fill in the state of @pid. Returns false if the scheduler doesn't know it. */
+static bool ctl_thread(struct gamesched_maps *maps, u32 pid,
+		       struct gamesched_ctl_thread *t)
 {
-	*game_threads_fd = bpf_obj_get(PIN_GAME_THREADS);
-	if (*game_threads_fd < 0) {
-		fprintf(stderr, "Error: GameSched scheduler is not running.\n");
-		fprintf(stderr, "Start it first with: sudo scx_gamesched\n");
-		return -1;
+	struct gamesched_detected det;
+	bool known = false;
+
+	memset(t, 0, sizeof(*t));
+	t->pid = pid;
+	t->prio = NR_PRIO_LEVELS;
+	t->pinned_cpu = -1;
+
+	known |= bpf_map_lookup_elem(maps->game_threads, &pid, &t->prio) == 0;
+	known |= bpf_map_lookup_elem(maps->pinned_threads, &pid, &t->pinned_cpu) == 0;
+	if (bpf_map_lookup_elem(maps->detected_threads, &pid, &det) == 0) {
+		t->period_ns = det.period_ns;
+		known = true;
 	}
 
-	*isolated_cpus_fd = bpf_obj_get(PIN_ISOLATED_CPUS);
-	*pinned_threads_fd = bpf_obj_get(PIN_PINNED_THREADS);
+	return known;
+}
 
+static int ctl_append(struct gamesched_ctl_thread **threads, u32 *nr,
+		      u32 *cap, const struct gamesched_ctl_thread *t)
+{
+	if (*nr == *cap) {
+		u32 new_cap = *cap ? *cap * 2 : 64;
+		struct gamesched_ctl_thread *p;
+
+		p = realloc(*threads, new_cap * sizeof(*p));
+		if (!p)
+			return -ENOMEM;
+		*threads = p;
+		*cap = new_cap;
+	}
+	(*threads)[(*nr)++] = *t;
 	return 0;
 }
 
+static int cmp_ctl_thread(const void *a, const void *b)
+{
+	const struct gamesched_ctl_thread *x = a, *y = b;
+
+	return x->pid < y->pid ? -1 : x->pid > y->pid;
+}
+
 /*
- * Pin BPF maps for the running scheduler.
+ * Append every thread the scheduler knows about, each once and sorted by
+ * pid: registered, pinned and detected threads, read with batch lookups.
  */
-static int pin_maps(struct scx_gamesched *skel)
+static int ctl_query_all(struct gamesched_maps *maps,
+			 struct gamesched_ctl_thread **threads, u32 *nr, u32 *cap)
 {
-	int ret;
+	struct map_batch reg = { .key_size = sizeof(u32), .val_size = sizeof(u32) };
+	struct map_batch pins = { .key_size = sizeof(u32), .val_size = sizeof(s32) };
+	struct map_batch det = {
+		.key_size = sizeof(u32),
+		.val_size = sizeof(struct gamesched_detected),
+	};
+	struct gamesched_ctl_thread t, *all;
+	u32 first = *nr, out = 0, i;
+	int ret = -EIO;
+
+	if (batch_read(maps->game_threads, &reg, "game threads") < 0 ||
+	    batch_read(maps->pinned_threads, &pins, "pins") < 0 ||
+	    batch_read(maps->detected_threads, &det, "detected threads") < 0)
+		goto out;
+
+	for (i = 0; i < reg.nr + pins.nr + det.nr; i++) {
+		memset(&t, 0, sizeof(t));
+		t.prio = NR_PRIO_LEVELS;
+		t.pinned_cpu = -1;
+
+		if (i < reg.nr) {
+			t.pid = ((u32 *)reg.keys)[i];
+			t.prio = ((u32 *)reg.vals)[i];
+		} else if (i < reg.nr + pins.nr) {
+			t.pid = ((u32 *)pins.keys)[i - reg.nr];
+			t.pinned_cpu = ((s32 *)pins.vals)[i - reg.nr];
+		} else {
+			t.pid = ((u32 *)det.keys)[i - reg.nr - pins.nr];
+			t.period_ns = ((struct gamesched_detected *)det.vals)
+				      [i - reg.nr - pins.nr].period_ns;
+		}
 
-	/* Create pin directory */
-	ret = mkdir(PIN_PATH, 0755);
-	if (ret && errno != EEXIST) {
-		fprintf(stderr, "Failed to create %s: %s\n", PIN_PATH, strerror(errno));
-		return -1;
+		ret = ctl_append(threads, nr, cap, &t);
+		if (ret < 0)
+			goto out;
 	}
 
-	/* Pin each map */
-	ret = bpf_map__pin(skel->maps.game_threads, PIN_GAME_THREADS);
-	if (ret) {
-		fprintf(stderr, "Failed to pin game_threads: %s\n", strerror(-ret));
-		return ret;
-	}
+	/* Fold the entries of a pid found in several maps into one */
+	all = *threads + first;
+	qsort(all, *nr - first, sizeof(*all), cmp_ctl_thread);
+	for (i = 0; i < *nr - first; i++) {
+		struct gamesched_ctl_thread *dst;
 
-	ret = bpf_map__pin(skel->maps.isolated_cpus, PIN_ISOLATED_CPUS);
-	if (ret) {
-		fprintf(stderr, "Failed to pin isolated_cpus: %s\n", strerror(-ret));
-		return ret;
+		if (!out || all[out - 1].pid != all[i].pid) {
+			all[out++] = all[i];
+			continue;
+		}
+		dst = &all[out - 1];
+		if (all[i].prio < NR_PRIO_LEVELS)
+			dst->prio = all[i].prio;
+		if (all[i].pinned_cpu >= 0)
+			dst->pinned_cpu = all[i].pinned_cpu;
+		if (all[i].period_ns)
+			dst->period_ns = all[i].period_ns;
 	}
+	*nr = first + out;
+	ret = 0;
+out:
+	batch_free(&reg);
+	batch_free(&pins);
+	batch_free(&det);
+	return ret;
+}
 
-	ret = bpf_map__pin(skel->maps.pinned_threads, PIN_PINNED_THREADS);
-	if (ret) {
-		fprintf(stderr, "Failed to pin pinned_threads: %s\n", strerror(-ret));
-		return ret;
+/*
+ * Apply one request. Returns 0 or -errno.
+ */
+static int ctl_apply(struct gamesched_maps *maps,
+		     const struct gamesched_ctl_req *req, bool *changed,
+		     struct gamesched_ctl_thread **threads, u32 *nr, u32 *cap)
+{
+	struct gamesched_ctl_thread t;
+	u32 pid = req->pid;
+
+	switch (req->op) {
+	case CTL_OP_ADD:
+		if (!pid || (req->prio != PRIO_GAME_RENDER &&
+			     req->prio != PRIO_GAME_OTHER))
+			return -EINVAL;
+		if (bpf_map_update_elem(maps->game_threads, &pid, &req->prio, BPF_ANY) < 0)
+			return -errno;
+		*changed = true;
+		return 0;
+	case CTL_OP_REMOVE:
+		if (bpf_map_delete_elem(maps->game_threads, &pid) < 0)
+			return -errno;
+		*changed = true;
+		return 0;
+	case CTL_OP_PIN:
+		if (!pid || req->cpu < 0 || req->cpu >= MAX_CPUS)
+			return -EINVAL;
+		if (!have_feature(maps, GAMESCHED_FLAG_PINNING))
+			return -EOPNOTSUPP;
+		if (bpf_map_update_elem(maps->pinned_threads, &pid, &req->cpu, BPF_ANY) < 0)
+			return -errno;
+		*changed = true;
+		return 0;
+	case CTL_OP_UNPIN:
+		if (!have_feature(maps, GAMESCHED_FLAG_PINNING))
+			return -EOPNOTSUPP;
+		if (bpf_map_delete_elem(maps->pinned_threads, &pid) < 0)
+			return -errno;
+		*changed = true;
+		return 0;
+	case CTL_OP_QUERY:
+		/* An unknown pid is reported in its entry, not as a failure */
+		if (!ctl_thread(maps, pid, &t))
+			t.status = -ENOENT;
+		return ctl_append(threads, nr, cap, &t);
+	case CTL_OP_QUERY_ALL:
+		return ctl_query_all(maps, threads, nr, cap);
+	case CTL_OP_HANDOFF:
+		/* Done by ctl_handoff() once the rest of the batch is applied */
+		return 0;
+	default:
+		return -EOPNOTSUPP;
 	}
-
-	return 0;
 }
 
 /*
- * Unpin BPF maps on exit.
+ * A reply being sent to a control client, CTL_MAX_THREADS thread entries
+ * per message, so a large query never needs a datagram over
+ * net.core.wmem_max. What a slow reader has no room for yet stays queued
+ * here and is sent from the event loop when its socket becomes writable.
  */
-static void unpin_maps(void)
+struct ctl_pending {
+	struct ctl_pending *next;
+	int fd;
+	struct gamesched_ctl_resp resp;
+	struct gamesched_ctl_thread *threads;
+	u32 nr, sent;
+};
+
+static struct ctl_pending *ctl_pending;
+
+/*
+ * Send as much of @p as the socket takes. Returns 0 when it is all sent,
+ * 1 when the socket is full, -1 when the client is gone.
+ */
+static int ctl_send(struct ctl_pending *p)
 {
-	unlink(PIN_GAME_THREADS);
-	unlink(PIN_ISOLATED_CPUS);
-	unlink(PIN_PINNED_THREADS);
-	rmdir(PIN_PATH);
+	do {
+		u32 n = p->nr - p->sent < CTL_MAX_THREADS ? p->nr - p->sent :
+							    CTL_MAX_THREADS;
+		struct iovec iov[2] = {
+			{ &p->resp, sizeof(p->resp) },
+			{ p->threads + p->sent, n * sizeof(*p->threads) },
+		};
+		struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+
+		p->resp.nr_threads = n;
+		p->resp.flags = p->sent + n < p->nr ? CTL_RESP_MORE : 0;
+		if (sendmsg(p->fd, &msg, MSG_NOSIGNAL) < 0)
+			return errno == EAGAIN ? 1 : -1;
+		p->sent += n;
+	} while (p->sent < p->nr);
+
+	return 0;
 }
 
 /*
- * Add a game thread to the scheduler (uses pinned maps).
+ * Reply to the client on @fd, taking ownership of @threads. The part the
+ * socket has no room for is queued and the client is switched to
+ * EPOLLOUT, so no new request is read from it before the reply is out.
  */
-static int cmd_add(int pid, const char *priority)
+static int ctl_reply(int epfd, int fd, struct gamesched_ctl_resp *resp,
+		     struct gamesched_ctl_thread *threads, u32 nr)
 {
-	int game_threads_fd, isolated_cpus_fd, pinned_threads_fd;
-	u32 prio;
-	u32 key = pid;
+	struct ctl_pending tmp = { .fd = fd, .resp = *resp, .threads = threads,
+				   .nr = nr }, *p;
+	struct epoll_event ev = { .events = EPOLLOUT, .data.fd = fd };
+	int ret;
 
-	if (strcmp(priority, "render") == 0)
-		prio = PRIO_GAME_RENDER;
-	else if (strcmp(priority, "game") == 0)
-		prio = PRIO_GAME_OTHER;
-	else {
-		fprintf(stderr, "Invalid priority: %s (use 'render' or 'game')\n",
-			priority);
-		return -1;
+	ret = ctl_send(&tmp);
+	if (ret <= 0) {
+		free(threads);
+		return ret;
 	}
 
-	if (open_pinned_maps(&game_threads_fd, &isolated_cpus_fd, &pinned_threads_fd) < 0)
-		return -1;
-
-	if (bpf_map_update_elem(game_threads_fd, &key, &prio, BPF_ANY) < 0) {
-		fprintf(stderr, "Failed to add PID %d: %s\n", pid, strerror(errno));
+	p = malloc(sizeof(*p));
+	if (!p || epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+		free(p);
+		free(threads);
 		return -1;
 	}
 
-	printf("Added PID %d with priority '%s'\n", pid, priority);
+	*p = tmp;
+	p->next = ctl_pending;
+	ctl_pending = p;
 	return 0;
 }
 
 /*
- * Remove a game thread from the scheduler.
+ * Continue the queued reply to the client on @fd once it is writable.
+ * Returns -1 when the client is gone and its fd should be closed.
  */
-static int cmd_remove(int pid)
+static int ctl_flush(int epfd, int fd)
 {
-	int game_threads_fd, isolated_cpus_fd, pinned_threads_fd;
-	u32 key = pid;
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+	struct ctl_pending **pp, *p;
+	int ret;
 
-	if (open_pinned_maps(&game_threads_fd, &isolated_cpus_fd, &pinned_threads_fd) < 0)
-		return -1;
+	for (pp = &ctl_pending; *pp && (*pp)->fd != fd; pp = &(*pp)->next)
+		;
+	p = *pp;
+	if (!p)
+		return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+
+	ret = ctl_send(p);
+	if (ret > 0)
+		return 0;
 
-	bpf_map_delete_elem(game_threads_fd, &key);
-	bpf_map_delete_elem(pinned_threads_fd, &key);
+	*pp = p->next;
+	free(p->threads);
+	free(p);
+	if (ret < 0)
+		return -1;
 
-	printf("Removed PID %d\n", pid);
-	return 0;
+	/* Back to reading requests */
+	return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
 }
 
 /*
- * Set CPU isolation.
+ * Close a control client, dropping any reply still queued for it.
  */
-static int cmd_isolate(const char *cpu_list)
+static void ctl_close(int fd)
 {
-	int game_threads_fd, isolated_cpus_fd, pinned_threads_fd;
-	int cpus[MAX_CPUS];
-	int count, i;
-	u32 value = 1;
-
-	if (open_pinned_maps(&game_threads_fd, &isolated_cpus_fd, &pinned_threads_fd) < 0)
-		return -1;
-
-	if (strcmp(cpu_list, "--clear") == 0 || strcmp(cpu_list, "clear") == 0) {
-		value = 0;
-		for (i = 0; i < MAX_CPUS; i++) {
-			u32 key = i;
-			bpf_map_update_elem(isolated_cpus_fd, &key, &value, BPF_ANY);
+	struct ctl_pending **pp, *p;
+
+	for (pp = &ctl_pending; *pp; pp = &(*pp)->next) {
+		if ((*pp)->fd == fd) {
+			p = *pp;
+			*pp = p->next;
+			free(p->threads);
+			free(p);
+			break;
 		}
-		printf("Cleared CPU isolation\n");
-		return 0;
 	}
 
-	count = parse_cpu_list(cpu_list, cpus, MAX_CPUS);
-	if (count < 0) {
-		fprintf(stderr, "Failed to parse CPU list\n");
-		return -1;
-	}
+	close(fd);
+}
 
-	for (i = 0; i < count; i++) {
-		u32 key = cpus[i];
-		if (bpf_map_update_elem(isolated_cpus_fd, &key, &value, BPF_ANY) < 0) {
-			fprintf(stderr, "Failed to isolate CPU %d: %s\n",
-				cpus[i], strerror(errno));
+/*
+ * Set when a GEN_REGISTRY bump for the control socket found the writer
+ * lock taken. The server never waits for it, the event loop retries.
+ */
+static bool ctl_bump_pending;
+
+#define CTL_RETRY_MS	10
+
+/*
+ * Publish control socket registrations without blocking: bump
+ * GEN_REGISTRY now if the writer lock is free, or leave it pending.
+ */
+static int ctl_publish(struct scx_gamesched *skel)
+{
+	struct gamesched_maps maps;
+	int lock, ret;
+
+	lock = lock_maps(false);
+	if (lock < 0) {
+		if (errno != EWOULDBLOCK)
 			return -1;
-		}
+		ctl_bump_pending = true;
+		return 0;
 	}
 
-	printf("Isolated CPUs: %s\n", cpu_list);
-	return 0;
+	skel_maps(skel, &maps);
+	ret = bump_generation_locked(&maps, GEN_REGISTRY);
+	ctl_bump_pending = false;
+	close(lock);
+	return ret;
 }
 
 /*
- * Pin a thread to a specific CPU.
+ * Hand the scheduler over to the new instance on @fd: detach, then send
+ * it @resp so it attaches. If the reply can't be sent, the requester has
+ * gone away and nobody would attach, so take the scheduler back.
  */
-static int cmd_pin(int pid, int cpu)
+static int ctl_handoff(struct scx_gamesched *skel, int fd,
+		       struct gamesched_ctl_resp *resp)
 {
-	int game_threads_fd, isolated_cpus_fd, pinned_threads_fd;
-	u32 key = pid;
-	s32 value = cpu;
+	/* The new instance steers IRQs from the original settings */
+	restore_noise();
+	steered_gen = ~0ULL;
 
-	if (open_pinned_maps(&game_threads_fd, &isolated_cpus_fd, &pinned_threads_fd) < 0)
-		return -1;
+	bpf_link__destroy(ops_link);
+	ops_link = NULL;
 
-	if (bpf_map_update_elem(pinned_threads_fd, &key, &value, BPF_ANY) < 0) {
-		fprintf(stderr, "Failed to pin PID %d to CPU %d: %s\n",
-			pid, cpu, strerror(errno));
-		return -1;
+	if (send(fd, resp, sizeof(*resp), MSG_NOSIGNAL | MSG_DONTWAIT) ==
+	    sizeof(*resp)) {
+		handed_off = true;
+		exit_req = 1;
+		return 0;
 	}
 
-	printf("Pinned PID %d to CPU %d\n", pid, cpu);
-	return 0;
+	fprintf(stderr, "Handoff requester went away, resuming\n");
+	ops_link = attach_ops(skel);
+	if (!ops_link) {
+		fprintf(stderr, "Failed to re-attach: %s\n", strerror(errno));
+		exit_req = 1;
+	}
+	return -1;
 }
 
 /*
- * Show current status.
+ * Serve one message from a control client. Returns -1 when the client is
+ * gone and its fd should be closed.
  */
-static int cmd_status(void)
+static int ctl_serve(struct scx_gamesched *skel, int epfd, int fd)
 {
-	int game_threads_fd, isolated_cpus_fd, pinned_threads_fd;
-	u32 key, next_key;
-	u32 prio;
-	s32 cpu;
-	u32 isolated;
-	int i;
+	struct gamesched_ctl_req reqs[CTL_MAX_REQS];
+	struct gamesched_ctl_resp resp = {};
+	struct gamesched_ctl_thread *threads = NULL;
+	struct gamesched_maps maps;
+	u32 nr = 0, cap = 0, nr_reqs;
+	bool changed = false, handoff = false;
+	ssize_t len;
+	int ret;
 
-	if (open_pinned_maps(&game_threads_fd, &isolated_cpus_fd, &pinned_threads_fd) < 0)
+	len = recv(fd, reqs, sizeof(reqs), MSG_TRUNC | MSG_DONTWAIT);
+	if (len < 0)
+		return errno == EAGAIN ? 0 : -1;
+	if (len == 0)
 		return -1;
 
-	printf("=== GameSched Status ===\n\n");
+	if (len > (ssize_t)sizeof(reqs))
+		resp.status = -E2BIG;
+	else if (len % sizeof(reqs[0]))
+		resp.status = -EINVAL;
+
+	skel_maps(skel, &maps);
+	nr_reqs = resp.status ? 0 : len / sizeof(reqs[0]);
+	for (u32 i = 0; i < nr_reqs; i++) {
+		/* A failed request doesn't hold up the ones after it */
+		ret = ctl_apply(&maps, &reqs[i], &changed, &threads, &nr, &cap);
+		handoff |= reqs[i].op == CTL_OP_HANDOFF;
+		if (ret < 0 && !resp.nr_failed++) {
+			resp.status = ret;
+			resp.failed = i;
+		}
+	}
 
-	/* Game threads */
-	printf("Game Threads:\n");
-	key = 0;
-	while (bpf_map_get_next_key(game_threads_fd, &key, &next_key) == 0) {
-		if (bpf_map_lookup_elem(game_threads_fd, &next_key, &prio) == 0) {
-			const char *prio_str = prio == PRIO_GAME_RENDER ? "render" :
-					       prio == PRIO_GAME_OTHER ? "game" : "normal";
-			printf("  PID %u: priority=%s", next_key, prio_str);
+	if (changed && ctl_publish(skel) < 0 && !resp.status)
+		resp.status = -errno;
 
-			if (bpf_map_lookup_elem(pinned_threads_fd, &next_key, &cpu) == 0 && cpu >= 0)
-				printf(" (pinned to CPU %d)", cpu);
-			printf("\n");
-		}
-		key = next_key;
+	if (handoff && !resp.status) {
+		free(threads);
+		return ctl_handoff(skel, fd, &resp);
+	}
+	return ctl_reply(epfd, fd, &resp, threads, nr);
+}
+
+static u64 now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Open the trace file at @path and write its header, recording that one
+ * in @sample events is traced.
+ */
+static FILE *trace_open(const char *path, u32 sample)
+{
+	struct gamesched_trace_hdr hdr = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.event_size = sizeof(struct gamesched_trace_event),
+		.sample = sample,
+	};
+	FILE *f;
+
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "Failed to open trace file %s: %s\n",
+			path, strerror(errno));
+		return NULL;
 	}
 
-	/* Isolated CPUs */
-	printf("\nIsolated CPUs: ");
-	int first = 1;
-	for (i = 0; i < MAX_CPUS && i < 64; i++) {
-		u32 cpu_key = i;
-		if (bpf_map_lookup_elem(isolated_cpus_fd, &cpu_key, &isolated) == 0 && isolated) {
-			if (!first) printf(",");
-			printf("%d", i);
-			first = 0;
-		}
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+		fprintf(stderr, "Failed to write trace file %s: %s\n",
+			path, strerror(errno));
+		fclose(f);
+		return NULL;
 	}
-	if (first)
-		printf("(none)");
-	printf("\n");
 
+	return f;
+}
+
+/* Ring buffer callback: append one event to the trace file */
+static int trace_write(void *ctx, void *data, size_t size)
+{
+	FILE *f = ctx;
+
+	if (size < sizeof(struct gamesched_trace_event))
+		return 0;
+	if (fwrite(data, sizeof(struct gamesched_trace_event), 1, f) != 1)
+		return -errno;
 	return 0;
 }
 
@@ -326,7 +3383,43 @@ static int cmd_status(void)
  */
 static int run_scheduler(struct scx_gamesched *skel)
 {
-	struct bpf_link *link;
+	int nr_cpus = libbpf_num_possible_cpus();
+	struct gamesched_stats *percpu, total;
+	struct gamesched_lat_hist *lat_percpu, lat_cur, lat_prev = {};
+	struct bpf_link *rename_link;
+	struct epoll_event ev = { .events = EPOLLIN }, events[16];
+	struct ring_buffer *trace_rb = NULL;
+	FILE *trace_file = NULL;
+	int ctl_fd, epfd, trace_fd = -1, lock = -1;
+	u64 next_report, last_report, prev_busy[NR_DOMAINS] = {};
+
+	percpu = calloc(nr_cpus, sizeof(*percpu));
+	lat_percpu = calloc(nr_cpus, sizeof(*lat_percpu));
+	if (!percpu || !lat_percpu)
+		return -1;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		fprintf(stderr, "Failed to create epoll instance: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (trace_path) {
+		trace_file = trace_open(trace_path, skel->rodata->trace_sample);
+		if (!trace_file)
+			return -1;
+		trace_rb = ring_buffer__new(bpf_map__fd(skel->maps.trace_events),
+					    trace_write, trace_file, NULL);
+		trace_fd = trace_rb ? ring_buffer__epoll_fd(trace_rb) : -1;
+		ev.data.fd = trace_fd;
+		if (trace_fd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, trace_fd, &ev) < 0) {
+			fprintf(stderr, "Failed to set up trace ring buffer\n");
+			return -1;
+		}
+	}
+
+	if (reload && take_over(skel, &lock) < 0)
+		return -1;
 
 	/* Pin maps so CLI can access them */
 	if (pin_maps(skel) < 0) {
@@ -334,28 +3427,153 @@ static int run_scheduler(struct scx_gamesched *skel)
 		return -1;
 	}
 
-	link = SCX_OPS_ATTACH(skel, gamesched_ops, scx_gamesched);
+	if (reload) {
+		ops_link = attach_ops(skel);
+		if (!ops_link) {
+			/* Keep the registrations for the next attempt */
+			fprintf(stderr, "Failed to attach: %s. Registrations are kept, "
+				"retry with -u\n", strerror(errno));
+			return -1;
+		}
+	} else {
+		ops_link = SCX_OPS_ATTACH(skel, gamesched_ops, scx_gamesched);
+	}
+
+	/* Taken by take_over(), CLI commands may publish again */
+	if (lock >= 0)
+		close(lock);
+
+	/* Re-classify TGID members when threads rename themselves */
+	rename_link = bpf_program__attach(skel->progs.gamesched_task_rename);
+	if (!rename_link)
+		fprintf(stderr, "Warning: failed to attach task_rename tracepoint, "
+			"thread-name rules only apply at thread creation\n");
+
+	ctl_fd = ctl_listen();
+	ev.data.fd = ctl_fd;
+	if (ctl_fd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, ctl_fd, &ev) < 0)
+		fprintf(stderr, "Warning: failed to create control socket %s: %s\n",
+			GAMESCHED_CTL_PATH, strerror(errno));
 
 	printf("GameSched running. Press Ctrl+C to exit.\n");
 	printf("Use 'scx_gamesched add --pid PID --priority render' to add game threads.\n\n");
 
+	next_report = last_report = now_ms();
 	while (!exit_req && !UEI_EXITED(skel, uei)) {
-		printf("game=%lu normal=%lu isolated_redirects=%lu\n",
-		       skel->bss->nr_game_dispatched,
-		       skel->bss->nr_normal_dispatched,
-		       skel->bss->nr_isolated_violations);
+		u64 now = now_ms();
+		int n, timeout;
+
+		if (now < next_report) {
+			timeout = next_report - now;
+			if (ctl_bump_pending && timeout > CTL_RETRY_MS)
+				timeout = CTL_RETRY_MS;
+			n = epoll_wait(epfd, events, 16, timeout);
+
+			for (int i = 0; i < n; i++) {
+				int fd = events[i].data.fd;
+
+				if (fd == trace_fd) {
+					if (ring_buffer__consume(trace_rb) < 0)
+						fprintf(stderr, "Failed to write trace: %s\n",
+							strerror(errno));
+				} else if (fd == ctl_fd) {
+					int cfd = accept4(ctl_fd, NULL, NULL,
+							  SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+					ev.data.fd = cfd;
+					if (cfd >= 0 &&
+					    epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &ev) < 0)
+						close(cfd);
+				} else if (events[i].events & EPOLLOUT ?
+					   ctl_flush(epfd, fd) < 0 :
+					   ctl_serve(skel, epfd, fd) < 0) {
+					ctl_close(fd);
+				}
+			}
+			if (ctl_bump_pending)
+				ctl_publish(skel);
+			continue;
+		}
+		next_report += 1000;
+
+		if (read_stats(skel, nr_cpus, percpu, &total) == 0) {
+			print_stats(skel, NULL, &total);
+			if (skel->rodata->domains_enabled)
+				print_domains(skel, percpu, nr_cpus, &total, prev_busy,
+					      (now - last_report) * 1000000ULL);
+			if (skel->rodata->cpuperf_control)
+				print_cpuperf(skel, nr_cpus);
+			if (skel->rodata->sched_flags & GAMESCHED_FLAG_ISOLATION)
+				print_isolation(skel, percpu, nr_cpus);
+
+			for (int cpu = 0; percpu_stats && cpu < nr_cpus; cpu++) {
+				char label[16];
+
+				snprintf(label, sizeof(label), "cpu%d", cpu);
+				print_stats(skel, label, &percpu[cpu]);
+			}
+		}
+		if (read_lat_hist(skel, nr_cpus, lat_percpu, &lat_cur) == 0) {
+			print_latency(&lat_cur, &lat_prev);
+			lat_prev = lat_cur;
+		}
+		if (steer_irqs)
+			steer_noise(skel);
 		fflush(stdout);
-		sleep(1);
+		last_report = now;
+	}
+	restore_noise();
+
+	/* After a handoff, the socket and the pins belong to the new instance */
+	if (ctl_fd >= 0) {
+		close(ctl_fd);
+		if (!handed_off)
+			unlink(GAMESCHED_CTL_PATH);
 	}
+	close(epfd);
 
-	bpf_link__destroy(link);
-	unpin_maps();
+	if (trace_rb) {
+		/* Drain what's left before closing the trace */
+		ring_buffer__consume(trace_rb);
+		ring_buffer__free(trace_rb);
+	}
+	if (trace_file)
+		fclose(trace_file);
+
+	if (rename_link)
+		bpf_link__destroy(rename_link);
+	bpf_link__destroy(ops_link);
+	if (handed_off)
+		printf("Handed off to the new instance\n");
+	else
+		unpin_maps();
+	free(lat_percpu);
+	free(percpu);
 	return 0;
 }
 
 int main(int argc, char **argv)
 {
 	struct scx_gamesched *skel;
+	bool llc_shards = false;
+	int preempt_prios = -1;
+	bool vtime_enabled = false;
+	long slice_us[NR_PRIO_LEVELS] = {};
+	long slice_min_us = 0;
+	bool render_detect = false;
+	bool boost_wakees = false;
+	long max_entries = 0;
+	bool quiet_siblings = false;
+	bool strict_isolation = false;
+	const char *game_domain = NULL;
+	bool hybrid_steering = false;
+	long perf_pct[NR_PRIO_LEVELS] = { -1, -1, -1, -1 };
+	bool cpuperf_control = false;
+	long share_pct[NR_PRIO_LEVELS] = { -1, -1, -1, -1 };
+	long starve_age_ms = -1;
+	int trace_prios = -1;
+	long trace_sample = 1;
+	int disabled = 0;
 	int opt;
 	const char *cmd = NULL;
 	int cmd_argc = 0;
@@ -377,8 +3595,125 @@ int main(int argc, char **argv)
 	}
 
 	/* Parse global options (before command) */
-	while ((opt = getopt(argc, argv, "vh")) != -1) {
+	while ((opt = getopt(argc, argv, "lp:ws:a:g:A:rbn:qkId:Hf:t:T:R:D:ucvh")) != -1) {
 		switch (opt) {
+		case 'l':
+			llc_shards = true;
+			break;
+		case 'p':
+			preempt_prios = parse_priority_mask(optarg);
+			if (preempt_prios < 0)
+				return 1;
+			break;
+		case 'w':
+			vtime_enabled = true;
+			break;
+		case 's':
+			if (parse_priority_values(optarg, slice_us) < 0)
+				return 1;
+			break;
+		case 'a':
+			slice_min_us = atol(optarg);
+			if (slice_min_us <= 0) {
+				fprintf(stderr, "Invalid adaptive slice: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'g': {
+			long total = 0;
+
+			if (parse_priority_values(optarg, share_pct) < 0)
+				return 1;
+			for (int i = 0; i < NR_PRIO_LEVELS; i++) {
+				if (share_pct[i] > 100) {
+					fprintf(stderr, "Invalid share: %ld%%\n",
+						share_pct[i]);
+					return 1;
+				}
+				if (share_pct[i] > 0)
+					total += share_pct[i];
+			}
+			if (total > 100) {
+				fprintf(stderr, "Shares add up to %ld%%\n", total);
+				return 1;
+			}
+			break;
+		}
+		case 'A':
+			starve_age_ms = atol(optarg);
+			if (starve_age_ms < 0) {
+				fprintf(stderr, "Invalid starvation age: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'r':
+			render_detect = true;
+			break;
+		case 'b':
+			boost_wakees = true;
+			break;
+		case 'n':
+			max_entries = atol(optarg);
+			if (max_entries <= 0) {
+				fprintf(stderr, "Invalid map capacity: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'q':
+			quiet_siblings = true;
+			break;
+		case 'k':
+			strict_isolation = true;
+			break;
+		case 'I':
+			steer_irqs = true;
+			break;
+		case 'd':
+			game_domain = optarg;
+			break;
+		case 'H':
+			hybrid_steering = true;
+			break;
+		case 'f':
+			if (parse_priority_values(optarg, perf_pct) < 0)
+				return 1;
+			/* Unset classes are -1, an explicit 0 is rejected */
+			for (int i = 0; i < NR_PRIO_LEVELS; i++) {
+				if (perf_pct[i] != -1 &&
+				    (perf_pct[i] < 1 || perf_pct[i] > 100)) {
+					fprintf(stderr, "Invalid perf target: %ld%% "
+						"(use 1-100)\n", perf_pct[i]);
+					return 1;
+				}
+			}
+			cpuperf_control = true;
+			break;
+		case 't':
+			trace_path = optarg;
+			break;
+		case 'T':
+			trace_prios = parse_priority_mask(optarg);
+			if (trace_prios < 0)
+				return 1;
+			break;
+		case 'R':
+			trace_sample = atol(optarg);
+			if (trace_sample <= 0) {
+				fprintf(stderr, "Invalid trace sampling rate: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'D':
+			disabled = parse_features(optarg);
+			if (disabled < 0)
+				return 1;
+			break;
+		case 'u':
+			reload = true;
+			break;
+		case 'c':
+			percpu_stats = true;
+			break;
 		case 'v':
 			verbose = true;
 			break;
@@ -391,54 +3726,118 @@ int main(int argc, char **argv)
 	/* Handle CLI subcommands (use pinned maps, don't load BPF) */
 	if (cmd) {
 		if (strcmp(cmd, "add") == 0) {
-			int pid = 0;
-			const char *priority = NULL;
+			int pid = 0, tgid = 0;
+			const char *priority = NULL, *comm = NULL;
+			const char *cgroup = NULL, *isolate = NULL;
 
 			for (int i = 1; i < cmd_argc; i++) {
 				if (strcmp(cmd_argv[i], "--pid") == 0 && i + 1 < cmd_argc)
 					pid = atoi(cmd_argv[++i]);
+				else if (strcmp(cmd_argv[i], "--tgid") == 0 && i + 1 < cmd_argc)
+					tgid = atoi(cmd_argv[++i]);
+				else if (strcmp(cmd_argv[i], "--cgroup") == 0 && i + 1 < cmd_argc)
+					cgroup = cmd_argv[++i];
+				else if (strcmp(cmd_argv[i], "--isolate") == 0 && i + 1 < cmd_argc)
+					isolate = cmd_argv[++i];
 				else if (strcmp(cmd_argv[i], "--priority") == 0 && i + 1 < cmd_argc)
 					priority = cmd_argv[++i];
+				else if (strcmp(cmd_argv[i], "--comm") == 0 && i + 1 < cmd_argc)
+					comm = cmd_argv[++i];
 			}
 
-			if (pid <= 0 || !priority) {
-				fprintf(stderr, "Usage: %s add --pid PID --priority render|game\n",
-					basename(argv[0]));
+			if ((pid > 0) + (tgid > 0) + !!cgroup != 1 || !priority) {
+				fprintf(stderr, "Usage: %s add --pid PID --priority render|game\n"
+					"       %s add --tgid TGID --priority render|game [--comm PATTERN=PRIO,...]\n"
+					"       %s add --cgroup PATH --priority render|game [--isolate CPU_LIST]\n",
+					basename(argv[0]), basename(argv[0]), basename(argv[0]));
 				return 1;
 			}
+			if (cgroup)
+				return cmd_add_cgroup(cgroup, priority, isolate) < 0 ? 1 : 0;
+			if (tgid > 0)
+				return cmd_add_tgid(tgid, priority, comm) < 0 ? 1 : 0;
 			return cmd_add(pid, priority) < 0 ? 1 : 0;
 
 		} else if (strcmp(cmd, "remove") == 0) {
-			int pid = 0;
+			int pid = 0, tgid = 0;
+			const char *comm = NULL, *cgroup = NULL;
 
 			for (int i = 1; i < cmd_argc; i++) {
 				if (strcmp(cmd_argv[i], "--pid") == 0 && i + 1 < cmd_argc)
 					pid = atoi(cmd_argv[++i]);
+				else if (strcmp(cmd_argv[i], "--cgroup") == 0 && i + 1 < cmd_argc)
+					cgroup = cmd_argv[++i];
+				else if (strcmp(cmd_argv[i], "--tgid") == 0 && i + 1 < cmd_argc)
+					tgid = atoi(cmd_argv[++i]);
+				else if (strcmp(cmd_argv[i], "--comm") == 0 && i + 1 < cmd_argc)
+					comm = cmd_argv[++i];
 			}
 
+			if (comm)
+				return cmd_remove_comm(comm) < 0 ? 1 : 0;
+			if (cgroup)
+				return cmd_remove_cgroup(cgroup) < 0 ? 1 : 0;
+			if (tgid > 0)
+				return cmd_remove_tgid(tgid) < 0 ? 1 : 0;
 			if (pid <= 0) {
-				fprintf(stderr, "Usage: %s remove --pid PID\n",
+				fprintf(stderr, "Usage: %s remove --pid PID | --tgid TGID | --cgroup PATH | --comm PATTERN\n",
 					basename(argv[0]));
 				return 1;
 			}
 			return cmd_remove(pid) < 0 ? 1 : 0;
 
 		} else if (strcmp(cmd, "isolate") == 0) {
+			enum isolate_scope scope = ISOLATE_CPUS;
 			const char *cpu_list = NULL;
 
 			for (int i = 1; i < cmd_argc; i++) {
-				if (strcmp(cmd_argv[i], "--cpus") == 0 && i + 1 < cmd_argc)
+				if (strcmp(cmd_argv[i], "--cpus") == 0 && i + 1 < cmd_argc) {
+					cpu_list = cmd_argv[++i];
+				} else if (strcmp(cmd_argv[i], "--cores") == 0 && i + 1 < cmd_argc) {
 					cpu_list = cmd_argv[++i];
-				else if (strcmp(cmd_argv[i], "--clear") == 0)
+					scope = ISOLATE_CORES;
+				} else if (strcmp(cmd_argv[i], "--llc") == 0 && i + 1 < cmd_argc) {
+					cpu_list = cmd_argv[++i];
+					scope = ISOLATE_LLC;
+				} else if (strcmp(cmd_argv[i], "--clear") == 0) {
 					cpu_list = "clear";
+				}
 			}
 
 			if (!cpu_list) {
-				fprintf(stderr, "Usage: %s isolate --cpus CPU_LIST | --clear\n",
-					basename(argv[0]));
+				fprintf(stderr, "Usage: %s isolate --cpus CPU_LIST | --cores CPU_LIST | "
+					"--llc CPU_LIST | --clear\n", basename(argv[0]));
+				return 1;
+			}
+			return cmd_isolate(cpu_list, scope) < 0 ? 1 : 0;
+
+		} else if (strcmp(cmd, "partition") == 0) {
+			const char *action = cmd_argc > 1 ? cmd_argv[1] : "";
+			const char *name = NULL, *cpu_list = NULL, *cgroup = NULL;
+			int tgid = 0;
+
+			for (int i = 2; i < cmd_argc; i++) {
+				if (strcmp(cmd_argv[i], "--name") == 0 && i + 1 < cmd_argc)
+					name = cmd_argv[++i];
+				else if (strcmp(cmd_argv[i], "--cpus") == 0 && i + 1 < cmd_argc)
+					cpu_list = cmd_argv[++i];
+				else if (strcmp(cmd_argv[i], "--tgid") == 0 && i + 1 < cmd_argc)
+					tgid = atoi(cmd_argv[++i]);
+				else if (strcmp(cmd_argv[i], "--cgroup") == 0 && i + 1 < cmd_argc)
+					cgroup = cmd_argv[++i];
+			}
+
+			if (strcmp(action, "remove") == 0 && name)
+				return cmd_partition_remove(name) < 0 ? 1 : 0;
+			if (strcmp(action, "add") != 0 || !name || !cpu_list ||
+			    (tgid > 0) + !!cgroup != 1) {
+				fprintf(stderr, "Usage: %s partition add --name NAME --cpus CPU_LIST "
+					"--tgid TGID | --cgroup PATH\n"
+					"       %s partition remove --name NAME\n",
+					basename(argv[0]), basename(argv[0]));
 				return 1;
 			}
-			return cmd_isolate(cpu_list) < 0 ? 1 : 0;
+			return cmd_partition_add(name, cpu_list, tgid, cgroup) < 0 ? 1 : 0;
 
 		} else if (strcmp(cmd, "pin") == 0) {
 			int pid = 0, cpu = -1;
@@ -457,6 +3856,21 @@ int main(int argc, char **argv)
 			}
 			return cmd_pin(pid, cpu) < 0 ? 1 : 0;
 
+		} else if (strcmp(cmd, "apply") == 0) {
+			const char *file = NULL;
+
+			for (int i = 1; i < cmd_argc; i++) {
+				if (strcmp(cmd_argv[i], "--file") == 0 && i + 1 < cmd_argc)
+					file = cmd_argv[++i];
+			}
+
+			if (!file) {
+				fprintf(stderr, "Usage: %s apply --file FILE|-\n",
+					basename(argv[0]));
+				return 1;
+			}
+			return cmd_apply(file) < 0 ? 1 : 0;
+
 		} else if (strcmp(cmd, "status") == 0) {
 			return cmd_status() < 0 ? 1 : 0;
 
@@ -469,6 +3883,55 @@ int main(int argc, char **argv)
 
 	/* No command - run the scheduler (load BPF, pin maps) */
 	skel = SCX_OPS_OPEN(gamesched_ops, scx_gamesched);
+	init_topology(skel);
+	if (game_domain && init_domains(skel, game_domain) < 0)
+		return 1;
+	skel->rodata->llc_shards = llc_shards;
+	if (preempt_prios >= 0)
+		skel->rodata->preempt_prios = preempt_prios;
+	skel->rodata->vtime_enabled = vtime_enabled;
+	for (int i = 0; i < NR_PRIO_LEVELS; i++) {
+		if (slice_us[i] > 0)
+			skel->rodata->prio_slice_ns[i] = slice_us[i] * 1000;
+	}
+	if (slice_min_us) {
+		skel->rodata->adaptive_slice = true;
+		skel->rodata->slice_min_ns = slice_min_us * 1000;
+	}
+	for (int i = 0; i < NR_PRIO_LEVELS; i++) {
+		if (share_pct[i] >= 0)
+			skel->rodata->prio_share[i] = share_pct[i];
+	}
+	if (starve_age_ms >= 0)
+		skel->rodata->starve_age_ns = starve_age_ms * 1000000ULL;
+	skel->rodata->sched_flags = GAMESCHED_FLAGS_ALL & ~disabled;
+	skel->rodata->trace_enabled = trace_path != NULL;
+	if (trace_prios >= 0)
+		skel->rodata->trace_prios = trace_prios;
+	skel->rodata->trace_sample = trace_sample;
+	/* Don't hold a ring buffer nobody reads */
+	if (!trace_path)
+		bpf_map__set_max_entries(skel->maps.trace_events,
+					 sysconf(_SC_PAGESIZE));
+	skel->rodata->render_detect = render_detect;
+	skel->rodata->boost_wakees = boost_wakees;
+	skel->rodata->quiet_siblings = quiet_siblings;
+	skel->rodata->strict_isolation = strict_isolation;
+	skel->rodata->hybrid_steering = hybrid_steering;
+	skel->rodata->cpuperf_control = cpuperf_control;
+	for (int i = 0; i < NR_PRIO_LEVELS; i++) {
+		if (perf_pct[i] > 0)
+			skel->rodata->prio_perf[i] = perf_pct[i] * PERF_SCALE / 100;
+	}
+	if (max_entries) {
+		bpf_map__set_max_entries(skel->maps.game_threads, max_entries);
+		bpf_map__set_max_entries(skel->maps.pinned_threads, max_entries);
+		bpf_map__set_max_entries(skel->maps.game_tgids, max_entries);
+		bpf_map__set_max_entries(skel->maps.detected_threads, max_entries);
+		bpf_map__set_max_entries(skel->maps.thread_stats, max_entries);
+	}
+	if (reload && reuse_pinned_maps(skel) < 0)
+		return 1;
 	SCX_OPS_LOAD(skel, gamesched_ops, scx_gamesched, uei);
 
 	run_scheduler(skel);
@@ -24,14 +24,272 @@ enum gamesched_priority {
 	NR_PRIO_LEVELS   = 4,
 };
 
-/* Maximum number of game threads we can track */
+/*
+ * Default capacity of the per-thread and per-process registration maps,
+ * can be raised at load time
+ */
 #define MAX_GAME_THREADS	1024
 
+/* Maximum number of cgroups registered as games */
+#define MAX_GAME_CGROUPS	256
+
+/* Maximum number of thread-name classification rules */
+#define MAX_COMM_RULES		16
+
+/* Length of a task comm, including the terminating NUL */
+#define COMM_LEN		16
+
+/*
+ * Thread-name rule: threads of a registered TGID whose comm starts with
+ * @pattern get priority @prio instead of the group's default. An empty
+ * pattern marks an unused slot.
+ */
+struct gamesched_comm_rule {
+	char pattern[COMM_LEN];
+	u32 prio;
+};
+
+/*
+ * A thread promoted to render by the frame-cadence detector, as reported
+ * to userspace. Times are CLOCK_MONOTONIC ns.
+ */
+struct gamesched_detected {
+	u32 tgid;
+	u32 pad;
+	u64 period_ns;		/* average wakeup interval */
+	u64 jitter_ns;		/* average deviation from period_ns */
+	u64 run_ns;		/* average run length per wakeup */
+	u64 last_seen_ns;	/* last periodic wakeup */
+};
+
 /* Maximum number of CPUs we can isolate */
 #define MAX_CPUS		256
 
-/* Configuration flags */
-#define GAMESCHED_FLAG_ENABLED		(1 << 0)
-#define GAMESCHED_FLAG_ISOLATION	(1 << 1)
+/*
+ * isolated_cpus holds two copies of the per-CPU isolation flags. BPF reads
+ * the copy selected by the GEN_ISOLATION generation; the CLI writes the
+ * other copy in one batch and then bumps the generation, so the whole set
+ * is swapped at once.
+ */
+#define ISOLATION_SLOT(gen, cpu)	(((gen) & 1) * MAX_CPUS + (cpu))
+
+/*
+ * Isolation partitions. Partition 0 is the shared isolation set managed by
+ * `isolate`, open to every game task. A named partition reserves its CPUs
+ * for the game tasks of one owner, a TGID or a cgroup, which in turn only
+ * use those CPUs. The isolated_cpus value of a CPU is its partition + 1,
+ * 0 if it isn't isolated.
+ */
+#define MAX_PARTITIONS		8
+#define PARTITION_NAME_LEN	16
+
+struct gamesched_partition {
+	char name[PARTITION_NAME_LEN];	/* empty if the slot is unused */
+	u32 owner_tgid;			/* 0 if owned by a cgroup */
+	u32 cgroup_level;		/* nesting level of owner_cgid */
+	u64 owner_cgid;			/* 0 if owned by a TGID */
+};
+
+/* Per-partition statistics, per CPU like gamesched_stats */
+struct gamesched_partition_stats {
+	u64 nr_enqueued;	/* owner tasks queued on the partition DSQs */
+	u64 nr_dispatched;	/* consumed from the partition DSQs */
+	u64 nr_direct;		/* dispatched straight to an idle partition CPU */
+	u64 nr_intrusions;	/* other tasks run on the partition's CPUs */
+	u64 busy_ns;		/* time the partition's CPUs ran tasks */
+};
+
+/*
+ * Live per-thread data of game, detected and pinned threads, as reported
+ * to userspace. Kept until the thread exits or stops qualifying.
+ */
+struct gamesched_thread_stats {
+	u32 tgid;
+	u32 prio;		/* class of the last run */
+	s32 last_cpu;		/* CPU of the last run */
+	u32 nr_migrations;	/* runs started on another CPU than the last */
+	u32 nr_redirects;	/* wakeups steered off the CPU first selected */
+	u32 pad;
+	u64 nr_runs;
+	u64 runtime_ns;		/* total time running */
+	u64 wait_ns;		/* total time runnable but not running */
+};
+
+/* Maximum number of last-level cache domains */
+#define MAX_LLCS		64
+
+/* Perf target of a CPU at full performance, same scale as SCX_CPUPERF_ONE */
+#define PERF_SCALE		1024
+
+/*
+ * Placement domains: game-class tasks prefer idle CPUs of the game domain
+ * (e.g. the V-cache CCD), everything else those of the system domain.
+ */
+enum gamesched_domain {
+	DOM_GAME	= 0,
+	DOM_SYSTEM	= 1,
+	NR_DOMAINS	= 2,
+};
+
+/*
+ * Generation counters, one slot per group of userspace-managed maps.
+ * The CLI bumps a slot after changing the maps it covers so that BPF can
+ * notice the change with a single array lookup and refresh its caches.
+ */
+enum gamesched_gen {
+	GEN_REGISTRY     = 0,	/* game_threads, pinned_threads, game_tgids,
+				   game_cgroups, comm_rules, partitions */
+	GEN_ISOLATION    = 1,	/* isolated_cpus, also selects its live copy */
+	NR_GENS,
+};
+
+/*
+ * Per-CPU statistics, kept in a BPF_MAP_TYPE_PERCPU_ARRAY and summed by
+ * userspace.
+ */
+struct gamesched_stats {
+	u64 nr_enqueued[NR_PRIO_LEVELS];	/* enqueue calls, by priority */
+	u64 nr_dispatched[NR_PRIO_LEVELS];	/* consumed from priority DSQs */
+	u64 nr_direct_dispatched;	/* select_cpu dispatched to an idle CPU */
+	u64 nr_pinned_dispatched;	/* consumed from the CPU's pinned DSQ */
+	u64 nr_local_dispatched;	/* LLC mode: consumed from own shard */
+	u64 nr_stolen_dispatched;	/* LLC mode: consumed from another shard */
+	u64 nr_isolated_violations;	/* normal tasks redirected off isolated CPUs */
+	u64 nr_isolated_blocked;	/* isolated CPU idled with normal work queued */
+	u64 nr_preemptions;		/* CPUs kicked to make room for a game task */
+	u64 nr_boosts;			/* wakees lifted to their game waker's class */
+	u64 nr_sibling_quiet;		/* dispatches skipped to quiet an SMT sibling */
+	u64 nr_domain_spills[NR_DOMAINS]; /* tasks placed outside their domain */
+	u64 busy_ns;			/* time spent running tasks */
+	u64 nr_capacity_fallbacks;	/* hybrid: work taken by the other class */
+	u64 nr_budget_dispatched;	/* served ahead of game work by share */
+	u64 nr_aged_dispatched;		/* served ahead of game work by age */
+	u64 nr_trace_dropped;		/* trace events lost to a full ring */
+	u64 nr_isolated_kthreads;	/* kernel threads run on isolated CPUs */
+	u64 nr_isolated_intrusions;	/* other non-game tasks run there */
+};
+
+/*
+ * Scheduling latency (runnable -> running) histograms, per CPU and per
+ * priority. Bucket i counts latencies in [2^i, 2^(i+1)) ns, the last bucket
+ * also takes everything above.
+ */
+#define NR_LAT_BUCKETS		40
+
+struct gamesched_lat_hist {
+	u64 buckets[NR_PRIO_LEVELS][NR_LAT_BUCKETS];
+};
+
+/*
+ * Scheduling trace. Sampled events go through a ring buffer to the
+ * scheduler process, which appends them to the trace file after a
+ * gamesched_trace_hdr.
+ */
+#define TRACE_MAGIC		"GSTRACE"
+#define TRACE_VERSION		2
+
+enum gamesched_trace_type {
+	TRACE_SELECT	= 1,	/* select_cpu picked @cpu */
+	TRACE_ENQUEUE	= 2,	/* task queued for @cpu */
+	TRACE_RUNNING	= 3,	/* task started on @cpu, @arg = wait (ns) */
+	TRACE_STOPPING	= 4,	/* task stopped on @cpu, @arg = runtime (ns) */
+};
+
+enum gamesched_trace_reason {
+	TRACE_R_NONE	= 0,
+	TRACE_R_PINNED	= 1,	/* pinned CPU or DSQ */
+	TRACE_R_DIRECT	= 2,	/* dispatched straight to an idle CPU */
+	TRACE_R_REDIRECT = 3,	/* moved off an isolated CPU */
+	TRACE_R_LOCAL	= 4,	/* kept on the CPU's local DSQ */
+	TRACE_R_PREEMPT	= 5,	/* preempted a lower-priority task */
+	TRACE_R_RUNNABLE = 6,	/* stopped while still runnable */
+};
+
+struct gamesched_trace_hdr {
+	char magic[8];		/* TRACE_MAGIC */
+	u32 version;		/* TRACE_VERSION */
+	u32 event_size;		/* sizeof(struct gamesched_trace_event) */
+	u32 sample;		/* one in @sample events recorded (-R), 1 for all */
+	u32 pad;
+};
+
+struct gamesched_trace_event {
+	u64 ts;			/* bpf_ktime_get_ns() */
+	u64 arg;		/* per type, see enum gamesched_trace_type */
+	u32 pid;
+	s32 cpu;
+	u8 type;		/* enum gamesched_trace_type */
+	u8 prio;
+	u8 reason;		/* enum gamesched_trace_reason */
+	u8 pad[5];
+};
+
+/*
+ * Control socket protocol. A client sends one SOCK_SEQPACKET message
+ * holding up to CTL_MAX_REQS requests; the scheduler applies them all in
+ * order, a failed one doesn't stop the rest, with a single generation
+ * bump. It answers with one or more messages, each a gamesched_ctl_resp
+ * followed by up to CTL_MAX_THREADS of the thread entries produced by
+ * queries; all but the last have CTL_RESP_MORE set.
+ */
+#define GAMESCHED_CTL_PATH	"/run/gamesched.sock"
+#define CTL_MAX_REQS		256
+#define CTL_MAX_THREADS		128
+
+enum gamesched_ctl_op {
+	CTL_OP_ADD	= 1,	/* register @pid with @prio (render or game) */
+	CTL_OP_REMOVE	= 2,	/* unregister @pid */
+	CTL_OP_PIN	= 3,	/* pin @pid to @cpu */
+	CTL_OP_UNPIN	= 4,	/* unpin @pid */
+	CTL_OP_QUERY	= 5,	/* state of @pid */
+	CTL_OP_QUERY_ALL = 6,	/* state of every registered, pinned or
+				   detected thread */
+	CTL_OP_HANDOFF	= 7,	/* detach and exit, leaving the pinned maps
+				   to the sender (reload) */
+};
+
+struct gamesched_ctl_req {
+	u32 op;			/* enum gamesched_ctl_op */
+	u32 pid;
+	u32 prio;
+	s32 cpu;
+};
+
+struct gamesched_ctl_thread {
+	u32 pid;
+	u32 prio;		/* registered priority, NR_PRIO_LEVELS if none */
+	s32 pinned_cpu;		/* -1 if not pinned */
+	s32 status;		/* 0, or -ENOENT for a query of an unknown pid */
+	u64 period_ns;		/* detected frame period, 0 if not detected */
+};
+
+#define CTL_RESP_MORE		(1 << 0)	/* more messages follow */
+
+struct gamesched_ctl_resp {
+	s32 status;		/* 0, or -errno of the first failed request */
+	u32 failed;		/* index of the first failed request */
+	u32 nr_threads;		/* gamesched_ctl_thread entries that follow */
+	u32 flags;		/* CTL_RESP_* */
+	u32 nr_failed;		/* number of failed requests */
+	u32 pad;
+};
+
+/*
+ * Feature flags, loaded into the sched_flags rodata. Without
+ * GAMESCHED_FLAG_ENABLED the flags are ignored and every feature is on;
+ * with it, features whose flag is clear are compiled out of the callbacks.
+ */
+#define GAMESCHED_FLAG_ENABLED		(1 << 0)	/* flags below are valid */
+#define GAMESCHED_FLAG_ISOLATION	(1 << 1)	/* CPU isolation */
+#define GAMESCHED_FLAG_PINNING		(1 << 2)	/* thread pinning */
+#define GAMESCHED_FLAGS_ALL		(GAMESCHED_FLAG_ENABLED |	\
+					 GAMESCHED_FLAG_ISOLATION |	\
+					 GAMESCHED_FLAG_PINNING)
+
+/* Slots of the sched_info map, published by the loader for the CLI */
+enum gamesched_info {
+	INFO_SCHED_FLAGS,		/* sched_flags of the running instance */
+	NR_INFOS,
+};
 
 #endif /* __SCX_GAMESCHED_H */
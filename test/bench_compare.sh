@@ -0,0 +1,31 @@
+#!/bin/bash
+# bench_compare.sh - Run the frame-latency benchmark under CFS and gamesched
+# Prints one JSON line per run, e.g. to append to a results file per release
+#
+# Usage: ./test/bench_compare.sh [gamesched_bench options]
+# (build first with: make && make bench)
+
+BENCH=./build/gamesched_bench
+SCHED=./build/scx_gamesched
+
+if [ -n "$(cat /sys/kernel/sched_ext/root/ops 2>/dev/null)" ]; then
+    echo "A sched_ext scheduler is already running, stop it first" >&2
+    exit 1
+fi
+
+$BENCH -l cfs "$@" || exit 1
+
+sudo $SCHED > /dev/null &
+SCHED_PID=$!
+# Wait for the control socket, so -r can register the frame thread
+for i in $(seq 1 50); do
+    [ -S /run/gamesched.sock ] && break
+    sleep 0.1
+done
+
+sudo $BENCH -l gamesched -r "$@"
+RET=$?
+
+sudo kill -INT $SCHED_PID
+wait $SCHED_PID
+exit $RET
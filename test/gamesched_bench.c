@@ -0,0 +1,410 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * gamesched_bench - Frame-latency benchmark
+ *
+ * Runs a periodic "frame" thread (like render_thread.sh, but with a precise
+ * period and amount of work) against N CPU burners and optional SMT or LLC
+ * noise, and measures:
+ *
+ * - wakeup latency: how late the frame thread starts after its timer
+ * - frame deadline misses: frames whose work finishes after the next one
+ *   should start
+ * - frame time: interval between consecutive frame completions
+ *
+ * Results go to stdout as one JSON object per run, tagged with the active
+ * scheduler, so runs under gamesched and CFS can be compared and tracked
+ * across releases. With -r the frame thread registers itself as a render
+ * thread through the scheduler's control socket.
+ *
+ * Copyright (c) 2026 GameSched Project
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint64_t u64;
+typedef int64_t s64;
+
+#include "scx_gamesched.h"
+
+#define NSEC_PER_USEC		1000ULL
+#define NSEC_PER_SEC		1000000000ULL
+
+/* Buffer the LLC noise thread streams through, well above any L3 */
+#define NOISE_BUF_SIZE		(256UL << 20)
+
+const char help_fmt[] =
+"Measure frame latency under CPU contention.\n"
+"\n"
+"Usage: %s [OPTIONS]\n"
+"\n"
+"Options:\n"
+"  -p PERIOD_US  Frame period (default: 16667, 60 Hz)\n"
+"  -w WORK_US    CPU work per frame (default: 4000)\n"
+"  -d SECONDS    Duration (default: 10)\n"
+"  -b N          Number of CPU burner threads (default: number of CPUs)\n"
+"  -c CPU        Pin the frame thread to CPU\n"
+"  -n smt|llc    Add noise: a memory streamer on the SMT sibling of the\n"
+"                frame CPU (needs -c), or an unpinned one thrashing the LLC\n"
+"  -r            Register the frame thread as render through %s\n"
+"  -l LABEL      Label for the results (default: the active scheduler)\n"
+"  -h            Display this help\n";
+
+enum noise_mode {
+	NOISE_NONE,
+	NOISE_SMT,
+	NOISE_LLC,
+};
+
+static u64 period_ns = 16667 * NSEC_PER_USEC;
+static u64 work_ns = 4000 * NSEC_PER_USEC;
+static u64 duration_ns = 10 * NSEC_PER_SEC;
+static int frame_cpu = -1;
+static enum noise_mode noise;
+static bool register_render;
+
+static volatile bool stop;
+
+/* Per-frame samples */
+static u64 *wake_lat, *frame_time;
+static size_t nr_frames, max_frames, nr_misses;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Spin for @ns of CPU time, so preemption stretches the frame */
+static void burn_cpu(u64 ns)
+{
+	struct timespec ts;
+	u64 start, cur;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	start = ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+	do {
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		cur = ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+	} while (cur - start < ns);
+}
+
+static int pin_self(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set);
+}
+
+/*
+ * Get the first SMT sibling of @cpu, or -1.
+ */
+static int smt_sibling(int cpu)
+{
+	char path[128], buf[64];
+	int first, second = -1;
+	FILE *f;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (!fgets(buf, sizeof(buf), f))
+		buf[0] = '\0';
+	fclose(f);
+
+	if (sscanf(buf, "%d%*[,-]%d", &first, &second) < 2)
+		return -1;
+	return first == cpu ? second : first;
+}
+
+/*
+ * Register the calling thread as a render thread through the control
+ * socket.
+ */
+static int register_self(void)
+{
+	struct gamesched_ctl_req req = {
+		.op = CTL_OP_ADD,
+		.pid = syscall(SYS_gettid),
+		.prio = PRIO_GAME_RENDER,
+	};
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct gamesched_ctl_resp resp;
+	int fd, ret = -1;
+
+	strncpy(addr.sun_path, GAMESCHED_CTL_PATH, sizeof(addr.sun_path) - 1);
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+	    send(fd, &req, sizeof(req), 0) == sizeof(req) &&
+	    recv(fd, &resp, sizeof(resp), 0) >= (ssize_t)sizeof(resp)) {
+		ret = resp.status;
+		errno = -resp.status;
+	}
+
+	close(fd);
+	return ret;
+}
+
+static void *burner_fn(void *arg)
+{
+	while (!stop)
+		burn_cpu(NSEC_PER_SEC / 100);
+	return NULL;
+}
+
+/* Stream through a large buffer, evicting the LLC and loading the core */
+static void *noise_fn(void *arg)
+{
+	volatile char *buf;
+	int cpu = (intptr_t)arg;
+
+	if (cpu >= 0 && pin_self(cpu) < 0)
+		fprintf(stderr, "Warning: failed to pin noise to CPU %d\n", cpu);
+
+	buf = malloc(NOISE_BUF_SIZE);
+	if (!buf)
+		return NULL;
+
+	while (!stop)
+		for (size_t i = 0; i < NOISE_BUF_SIZE && !stop; i += 64)
+			buf[i]++;
+
+	free((void *)buf);
+	return NULL;
+}
+
+static void *frame_fn(void *arg)
+{
+	struct timespec ts;
+	u64 next, start, last_done = 0;
+
+	if (frame_cpu >= 0 && pin_self(frame_cpu) < 0)
+		fprintf(stderr, "Warning: failed to pin frame thread to CPU %d\n",
+			frame_cpu);
+	if (register_render && register_self() < 0)
+		fprintf(stderr, "Warning: failed to register as render thread: %s\n",
+			strerror(errno));
+
+	start = now_ns();
+	next = start + period_ns;
+	while (!stop && nr_frames < max_frames &&
+	       next - start <= duration_ns) {
+		u64 woke, done;
+
+		ts.tv_sec = next / NSEC_PER_SEC;
+		ts.tv_nsec = next % NSEC_PER_SEC;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+			;
+
+		woke = now_ns();
+		burn_cpu(work_ns);
+		done = now_ns();
+
+		wake_lat[nr_frames] = woke - next;
+		frame_time[nr_frames] = last_done ? done - last_done : 0;
+		nr_frames++;
+		last_done = done;
+
+		if (done > next + period_ns)
+			nr_misses++;
+
+		/* Skip the frames that were missed entirely, like vsync would */
+		next += period_ns;
+		while (next < done)
+			next += period_ns;
+	}
+
+	stop = true;
+	return NULL;
+}
+
+/*
+ * Get the name of the active scheduler: the sched_ext ops name if one is
+ * loaded, otherwise "cfs".
+ */
+static void sched_name(char *buf, size_t size)
+{
+	FILE *f;
+
+	snprintf(buf, size, "cfs");
+	f = fopen("/sys/kernel/sched_ext/root/ops", "r");
+	if (!f)
+		return;
+	if (fgets(buf, size, f))
+		buf[strcspn(buf, "\n")] = '\0';
+	else
+		snprintf(buf, size, "cfs");
+	fclose(f);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Get the @pct percentile of the sorted @vals, in us */
+static double percentile(const u64 *vals, size_t nr, double pct)
+{
+	size_t i = nr * pct / 100;
+
+	if (!nr)
+		return 0;
+	return vals[i < nr ? i : nr - 1] / 1e3;
+}
+
+static void print_results(const char *label, int nr_burners)
+{
+	size_t nr_times = nr_frames > 1 ? nr_frames - 1 : 0;
+
+	qsort(wake_lat, nr_frames, sizeof(*wake_lat), cmp_u64);
+	/* The first frame has no previous completion */
+	qsort(frame_time + 1, nr_times, sizeof(*frame_time), cmp_u64);
+
+	printf("{\"label\":\"%s\",\"period_us\":%lu,\"work_us\":%lu,"
+	       "\"burners\":%d,\"noise\":\"%s\",\"frames\":%zu,\"misses\":%zu,"
+	       "\"miss_pct\":%.2f,"
+	       "\"wake_p50_us\":%.1f,\"wake_p99_us\":%.1f,\"wake_p999_us\":%.1f,"
+	       "\"wake_max_us\":%.1f,"
+	       "\"frame_p50_us\":%.1f,\"frame_p99_us\":%.1f,\"frame_p999_us\":%.1f,"
+	       "\"frame_max_us\":%.1f}\n",
+	       label, (unsigned long)(period_ns / NSEC_PER_USEC),
+	       (unsigned long)(work_ns / NSEC_PER_USEC),
+	       nr_burners, noise == NOISE_SMT ? "smt" : noise == NOISE_LLC ? "llc" : "none",
+	       nr_frames, nr_misses,
+	       nr_frames ? 100.0 * nr_misses / nr_frames : 0,
+	       percentile(wake_lat, nr_frames, 50),
+	       percentile(wake_lat, nr_frames, 99),
+	       percentile(wake_lat, nr_frames, 99.9),
+	       percentile(wake_lat, nr_frames, 100),
+	       percentile(frame_time + 1, nr_times, 50),
+	       percentile(frame_time + 1, nr_times, 99),
+	       percentile(frame_time + 1, nr_times, 99.9),
+	       percentile(frame_time + 1, nr_times, 100));
+}
+
+int main(int argc, char **argv)
+{
+	int nr_burners = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t frame, noise_thread, *burners;
+	char label[64] = "";
+	int opt, noise_cpu = -1;
+
+	while ((opt = getopt(argc, argv, "p:w:d:b:c:n:rl:h")) != -1) {
+		switch (opt) {
+		case 'p':
+			period_ns = atol(optarg) * NSEC_PER_USEC;
+			break;
+		case 'w':
+			work_ns = atol(optarg) * NSEC_PER_USEC;
+			break;
+		case 'd':
+			duration_ns = atol(optarg) * NSEC_PER_SEC;
+			break;
+		case 'b':
+			nr_burners = atoi(optarg);
+			break;
+		case 'c':
+			frame_cpu = atoi(optarg);
+			break;
+		case 'n':
+			if (strcmp(optarg, "smt") == 0) {
+				noise = NOISE_SMT;
+			} else if (strcmp(optarg, "llc") == 0) {
+				noise = NOISE_LLC;
+			} else {
+				fprintf(stderr, "Invalid noise mode: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'r':
+			register_render = true;
+			break;
+		case 'l':
+			snprintf(label, sizeof(label), "%s", optarg);
+			break;
+		case 'h':
+		default:
+			fprintf(opt == 'h' ? stdout : stderr, help_fmt,
+				basename(argv[0]), GAMESCHED_CTL_PATH);
+			return opt != 'h';
+		}
+	}
+
+	if (!period_ns || !work_ns || !duration_ns || nr_burners < 0) {
+		fprintf(stderr, "Period, work and duration must be positive\n");
+		return 1;
+	}
+
+	if (noise == NOISE_SMT) {
+		if (frame_cpu < 0) {
+			fprintf(stderr, "SMT noise needs the frame CPU (-c)\n");
+			return 1;
+		}
+		noise_cpu = smt_sibling(frame_cpu);
+		if (noise_cpu < 0) {
+			fprintf(stderr, "CPU %d has no SMT sibling\n", frame_cpu);
+			return 1;
+		}
+	}
+
+	if (!label[0])
+		sched_name(label, sizeof(label));
+
+	max_frames = duration_ns / period_ns + 1;
+	wake_lat = calloc(max_frames, sizeof(*wake_lat));
+	frame_time = calloc(max_frames, sizeof(*frame_time));
+	burners = calloc(nr_burners ? nr_burners : 1, sizeof(*burners));
+	if (!wake_lat || !frame_time || !burners)
+		return 1;
+
+	for (int i = 0; i < nr_burners; i++) {
+		if (pthread_create(&burners[i], NULL, burner_fn, NULL)) {
+			fprintf(stderr, "Failed to start burner %d\n", i);
+			return 1;
+		}
+	}
+	if (noise != NOISE_NONE &&
+	    pthread_create(&noise_thread, NULL, noise_fn, (void *)(intptr_t)noise_cpu)) {
+		fprintf(stderr, "Failed to start noise thread\n");
+		return 1;
+	}
+	if (pthread_create(&frame, NULL, frame_fn, NULL)) {
+		fprintf(stderr, "Failed to start frame thread\n");
+		return 1;
+	}
+
+	pthread_join(frame, NULL);
+	for (int i = 0; i < nr_burners; i++)
+		pthread_join(burners[i], NULL);
+	if (noise != NOISE_NONE)
+		pthread_join(noise_thread, NULL);
+
+	print_results(label, nr_burners);
+	return 0;
+}